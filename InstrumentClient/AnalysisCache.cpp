@@ -0,0 +1,185 @@
+#include "AnalysisCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <glog/logging.h>
+#include <limits.h>
+#include <sstream>
+#include <stdlib.h>
+
+#include "CFG.h"
+
+using namespace Dyninst;
+using namespace romp;
+using namespace std;
+
+#define CACHE_MAGIC "romp-analysis-cache"
+#define CACHE_VERSION 3
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+/*
+ * Identify the program by its canonical path. A build id would change with 
+ * every rebuild, which the cache is meant to survive.
+ */
+static string getProgramIdentity(const string& programPath) {
+  char resolved[PATH_MAX];
+  if (realpath(programPath.c_str(), resolved) == nullptr) {
+    return programPath;
+  }
+  return string(resolved);
+}
+
+AnalysisCache::AnalysisCache(
+        const string& cachePath,
+        const string& arch,
+        const string& programPath) : cachePath_(cachePath), arch_(arch),
+                            program_(getProgramIdentity(programPath)) {}
+
+/*
+ * Read cached entries from the cache file. A missing file is not an error,
+ * the cache is populated at the end of this run. Return false if the file
+ * exists but can not be used, e.g., it was written for another program or
+ * architecture. Its entries are then replaced at the end of this run.
+ */
+bool
+AnalysisCache::load() {
+  ifstream input(cachePath_);
+  if (!input.is_open()) {
+    LOG(INFO) << "analysis cache " << cachePath_ << " does not exist yet";
+    return true;
+  }
+  string magic, arch, program;
+  int version = 0;
+  input >> magic >> version >> arch >> ws;
+  getline(input, program);
+  if (magic != CACHE_MAGIC || version != CACHE_VERSION || arch != arch_ ||
+      program != program_) {
+    LOG(WARNING) << "ignoring analysis cache " << cachePath_ << " written "
+                 << "for another program, architecture or cache version";
+    return false;
+  }
+  string tag;
+  while (input >> tag) {
+    if (tag != "F") {
+      LOG(WARNING) << "corrupted analysis cache " << cachePath_;
+      entries_.clear();
+      return false;
+    }
+    uint64_t functionHash = 0;
+    size_t numPoints = 0;
+    input >> hex >> functionHash >> dec >> numPoints;
+    vector<CachedPoint> points(numPoints);
+    for (auto& point : points) {
+      int decision = 0;
+      input >> hex >> point.offset >> dec >> decision >> point.isWrite
+            >> point.hardWareLock;
+      point.decision = static_cast<PointDecision>(decision);
+    }
+    if (!input) {
+      LOG(WARNING) << "truncated analysis cache " << cachePath_;
+      entries_.clear();
+      return false;
+    }
+    entries_[functionHash] = move(points);
+  }
+  LOG(INFO) << "loaded " << entries_.size() << " cached functions from "
+            << cachePath_;
+  return true;
+}
+
+/*
+ * Write entries used in this run to the cache file. Entries of functions
+ * that no longer exist in the binary are dropped. The file is replaced
+ * atomically so an interrupted run does not leave a corrupted cache.
+ */
+bool
+AnalysisCache::save() {
+  auto tmpPath = cachePath_ + ".tmp";
+  {
+    ofstream output(tmpPath, ios::trunc);
+    if (!output.is_open()) {
+      LOG(WARNING) << "cannot write analysis cache " << tmpPath;
+      return false;
+    }
+    output << CACHE_MAGIC << " " << CACHE_VERSION << " " << arch_ << " "
+           << program_ << "\n";
+    for (const auto& entry : liveEntries_) {
+      output << "F " << hex << entry.first << dec << " "
+             << entry.second.size() << "\n";
+      for (const auto& point : entry.second) {
+        output << hex << point.offset << dec << " " << point.decision << " "
+               << point.isWrite << " " << point.hardWareLock << "\n";
+      }
+    }
+    if (!output) {
+      LOG(WARNING) << "failed writing analysis cache " << tmpPath;
+      return false;
+    }
+  }
+  if (rename(tmpPath.c_str(), cachePath_.c_str()) != 0) {
+    LOG(WARNING) << "cannot replace analysis cache " << cachePath_;
+    return false;
+  }
+  LOG(INFO) << "saved " << liveEntries_.size() << " functions to analysis "
+            << "cache " << cachePath_;
+  return true;
+}
+
+const vector<CachedPoint>*
+AnalysisCache::lookup(uint64_t functionHash) const {
+  auto it = entries_.find(functionHash);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  return &(it->second);
+}
+
+void
+AnalysisCache::update(uint64_t functionHash, vector<CachedPoint>&& points) {
+  liveEntries_[functionHash] = move(points);
+}
+
+/*
+ * Compute FNV-1a hash over the code bytes of all basic blocks of the
+ * function. Block offsets relative to the function entry are mixed in so
+ * that reordered blocks produce a different hash. Return false if the code
+ * bytes are not available.
+ */
+bool
+AnalysisCache::hashFunction(ParseAPI::Function* parseFunction,
+                            uint64_t& functionHash,
+                            Address& entryAddress) {
+  entryAddress = parseFunction->addr();
+  vector<ParseAPI::Block*> blocks;
+  for (auto block : parseFunction->blocks()) {
+    blocks.push_back(block);
+  }
+  sort(blocks.begin(), blocks.end(),
+       [](ParseAPI::Block* a, ParseAPI::Block* b) {
+         return a->start() < b->start();
+       });
+  auto hash = static_cast<uint64_t>(FNV_OFFSET_BASIS);
+  auto mix = [&hash](uint8_t byte) {
+    hash ^= byte;
+    hash *= FNV_PRIME;
+  };
+  for (auto block : blocks) {
+    auto offset = block->start() - entryAddress;
+    for (int i = 0; i < 8; ++i) {
+      mix(static_cast<uint8_t>(offset >> (i * 8)));
+    }
+    auto size = block->end() - block->start();
+    auto bytes = static_cast<const uint8_t*>(
+            parseFunction->isrc()->getPtrToInstruction(block->start()));
+    if (!bytes) {
+      return false;
+    }
+    for (Address i = 0; i < size; ++i) {
+      mix(bytes[i]);
+    }
+  }
+  functionHash = hash;
+  return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CFG.h"
+
+namespace romp {
+  /*
+   * Instrumentation decision made for one load/store point.
+   */
+  enum PointDecision {
+    eInstrument = 0,
+    eSkipPrefetch = 1,
+    eSkipUnknownType = 2,
+    eSkipThreadPrivate = 3,
+  };
+
+  /*
+   * Cached analysis result of one load/store point. The point is identified
+   * by its offset from the function entry so that the result stays valid
+   * when an unchanged function moves in a rebuilt binary.
+   */
+  typedef struct CachedPoint {
+    CachedPoint() {}
+    CachedPoint(uint64_t offset, PointDecision decision, bool isWrite,
+                bool hardWareLock): offset(offset), decision(decision),
+                                    isWrite(isWrite),
+                                    hardWareLock(hardWareLock) {}
+    uint64_t offset;
+    PointDecision decision;
+    bool isWrite;
+    bool hardWareLock;
+  } CachedPoint;
+
+  /*
+   * AnalysisCache persists per function instrumentation decisions on disk.
+   * Entries are keyed by a hash of the function's code bytes, so unchanged
+   * functions of a rebuilt binary reuse their decisions instead of being
+   * decoded again. `lookup` may be called concurrently once the cache is
+   * loaded; `update` and `save` are expected to be called serially.
+   */
+  class AnalysisCache {
+    public:
+      AnalysisCache(const std::string& cachePath, const std::string& arch,
+                    const std::string& programPath);
+      bool load();
+      bool save();
+      const std::vector<CachedPoint>* lookup(uint64_t functionHash) const;
+      void update(uint64_t functionHash, std::vector<CachedPoint>&& points);
+      static bool hashFunction(Dyninst::ParseAPI::Function* parseFunction,
+                               uint64_t& functionHash,
+                               Dyninst::Address& entryAddress);
+    private:
+      std::string cachePath_;
+      std::string arch_;
+      // canonical path of the program the cached decisions belong to
+      std::string program_;
+      // entries read from the cache file
+      std::unordered_map<uint64_t, std::vector<CachedPoint>> entries_;
+      // entries used or created in this run, these are written back
+      std::unordered_map<uint64_t, std::vector<CachedPoint>> liveEntries_;
+  };
+}
@@ -1,6 +1,14 @@
 #include "InstrumentClient.h"
 
+#include <algorithm>
+#include <fstream>
 #include <glog/logging.h>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "InstructionDecoder.h"
+#include "Register.h"
 
 using namespace Dyninst;
 using namespace romp;
@@ -9,15 +17,68 @@ using namespace std;
 #define MATCH_LIB(buffer, target) \
       buffer.find(target) != string::npos
 
+/*
+ * Split a comma separated list of regular expressions.
+ */
+static vector<regex> parsePatterns(const string& patterns) {
+  vector<regex> result;
+  stringstream patternStream(patterns);
+  string pattern;
+  while (getline(patternStream, pattern, ',')) {
+    if (pattern.empty()) {
+      continue;
+    }
+    try {
+      result.emplace_back(pattern);
+    } catch (const regex_error& e) {
+      LOG(FATAL) << "invalid pattern `" << pattern << "`: " << e.what();
+    }
+  }
+  return result;
+}
+
+static bool matchAny(const vector<regex>& patterns, const string& name) {
+  for (const auto& pattern : patterns) {
+    if (regex_search(name, pattern)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 InstrumentClient::InstrumentClient(
         const string& programName, 
         const string& rompLibPath,
         shared_ptr<BPatch> bpatchPtr,
         const string& arch,
-        const string& modSuffix) : bpatchPtr_(move(bpatchPtr)), 
-                                   programName_(programName),
-                                   arch_(arch),
-                                   modSuffix_(modSuffix) {
+        const string& modSuffix,
+        int numThreads,
+        const string& analysisCachePath,
+        const string& profilePaths,
+        bool inlineGuard,
+        const InstrumentFilters& filters) : bpatchPtr_(move(bpatchPtr)), 
+                          checkEnabledVar_(nullptr),
+                          programName_(programName),
+                          arch_(arch),
+                          modSuffix_(modSuffix),
+                          numThreads_(numThreads),
+                          decodeNanos_(0) {
+  if (numThreads_ <= 0) {
+    numThreads_ = max(1u, thread::hardware_concurrency());
+  }
+  if (!analysisCachePath.empty()) {
+    analysisCache_ = make_unique<AnalysisCache>(analysisCachePath, arch_, 
+                                               programName);
+    analysisCache_->load();
+  }
+  if (!profilePaths.empty()) {
+    loadInstnProfiles(profilePaths);
+  }
+  includeModules_ = parsePatterns(filters.includeModules);
+  excludeModules_ = parsePatterns(filters.excludeModules);
+  includeFunctions_ = parsePatterns(filters.includeFunctions);
+  excludeFunctions_ = parsePatterns(filters.excludeFunctions);
+  PhaseTimer timer("open binary and load romp library");
   addrSpacePtr_ = initInstrumenter(programName, rompLibPath);
   checkAccessFuncs_ = getCheckAccessFuncs(addrSpacePtr_);
   if (checkAccessFuncs_.size() == 0)  {
@@ -26,7 +87,20 @@ InstrumentClient::InstrumentClient(
   if (!checkAccessFuncs_[0]) {
       LOG(FATAL) << "error empty first checkAccessFuncs_ element";
   }
-  LOG(INFO) << "InstrumentClient initialized with arch: " << arch_;
+  if (inlineGuard) {
+    checkEnabledVar_ = getCheckEnabledVar(addrSpacePtr_);
+  }
+  LOG(INFO) << "InstrumentClient initialized with arch: " << arch_
+            << " analysis threads: " << numThreads_;
+}
+
+PhaseTimer::PhaseTimer(const string& phaseName) : phaseName_(phaseName),
+                                         start_(chrono::steady_clock::now()) {}
+
+PhaseTimer::~PhaseTimer() {
+  auto elapsed = chrono::duration<double>(
+          chrono::steady_clock::now() - start_).count();
+  LOG(INFO) << "phase [" << phaseName_ << "] took " << elapsed << " s";
 }
 
 unique_ptr<BPatch_addressSpace> 
@@ -70,10 +144,29 @@ InstrumentClient::getCheckAccessFuncs(
   return checkAccessFuncs;
 }
 
+/*
+ * Get the dyninst representation of the `gRompCheckEnabled` word defined in
+ * romp library code CoreUtil.cpp. Return nullptr if the loaded romp library
+ * does not define it, in which case `checkAccess` calls are not guarded.
+ */
+BPatch_variableExpr*
+InstrumentClient::getCheckEnabledVar(
+      const unique_ptr<BPatch_addressSpace>& addrSpacePtr) {
+  auto appImage = addrSpacePtr->getImage();
+  if (!appImage) {
+    LOG(FATAL) << "cannot get image";
+  }
+  auto checkEnabledVar = appImage->findVariable("gRompCheckEnabled", false);
+  if (!checkEnabledVar) {
+    LOG(WARNING) << "cannot find `gRompCheckEnabled` in romp lib, "
+                 << "checkAccess calls are not guarded";
+  }
+  return checkEnabledVar;
+}
+
 /* 
- * Get dyninst representation of all all functions in the 
- * program being instrumented. Ideally, no function should 
- * be skipped.
+ * Get dyninst representation of all functions in the program being 
+ * instrumented that pass the module and function filters.
  */ 
 vector<BPatch_function*> 
 InstrumentClient::getFunctionsVector(
@@ -88,60 +181,459 @@ InstrumentClient::getFunctionsVector(
     LOG(FATAL) << "cannot get modules";
   }
   char nameBuffer[MODULE_NAME_LENGTH];
+  uint64_t numFiltered = 0;
   for (const auto& module : *appModules) {
-    LOG(INFO) << "module name: " 
-              << module->getFullName(nameBuffer, MODULE_NAME_LENGTH);
-    if (module->isSharedLib()) { 
-      //LOG(INFO) << "skip module: " << nameBuffer;
+    auto moduleName = string(
+            module->getFullName(nameBuffer, MODULE_NAME_LENGTH));
+    if (!shouldInstrumentModule(moduleName, module->isSharedLib())) {
       continue;
     }
+    LOG(INFO) << "instrumenting module: " << moduleName;
     auto procedures = module->getProcedures();
     for (const auto& procedure : *procedures) {
+      if (shouldInstrumentFunction(procedure)) {
         funcVec.push_back(procedure);
+      } else {
+        numFiltered++;
+      }
     }
   }
+  LOG(INFO) << "selected " << funcVec.size() << " functions, filtered out " 
+            << numFiltered;
   return funcVec;
 }
 
+/*
+ * Modules of the executable are instrumented unless excluded. Shared 
+ * libraries have to be opted in. The romp library and the dyninst runtime 
+ * library are never instrumented.
+ */
+bool
+InstrumentClient::shouldInstrumentModule(const string& moduleName,
+                                         bool isSharedLib) {
+  if (MATCH_LIB(moduleName, "libromp") || 
+      MATCH_LIB(moduleName, "libdyninstAPI_RT")) {
+    return false;
+  }
+  if (matchAny(excludeModules_, moduleName)) {
+    return false;
+  }
+  if (isSharedLib) {
+    return matchAny(includeModules_, moduleName);
+  }
+  return true;
+}
+
+/*
+ * Match filters against both the pretty and the mangled function name.
+ */
+bool
+InstrumentClient::shouldInstrumentFunction(BPatch_function* function) {
+  if (includeFunctions_.empty() && excludeFunctions_.empty()) {
+    return true;
+  }
+  auto name = function->getName();
+  auto mangledName = function->getMangledName();
+  if (matchAny(excludeFunctions_, name) || 
+      matchAny(excludeFunctions_, mangledName)) {
+    return false;
+  }
+  if (includeFunctions_.empty()) {
+    return true;
+  }
+  return matchAny(includeFunctions_, name) || 
+         matchAny(includeFunctions_, mangledName);
+}
+
 /* 
  * Public interface for InstrumentClient, wraps the internal 
  * implementation of instrumentation of memory accesses
  */
 void
 InstrumentClient::instrumentMemoryAccess() {  
-  auto functions = getFunctionsVector(addrSpacePtr_);
+  vector<BPatch_function*> functions;
+  {
+    PhaseTimer timer("collect functions");
+    functions = getFunctionsVector(addrSpacePtr_);
+  }
   instrumentMemoryAccessInternal(addrSpacePtr_, functions);
+  PhaseTimer timer("finish instrumentation");
   finishInstrumentation(addrSpacePtr_);
 }
 
 /*
  * Instrument memory accesses in each function by inserting the 
- * `checkAccess` function call 
+ * `checkAccess` function call. BPatch is not thread safe, so only the 
+ * decoding of functions through ParseAPI and InstructionAPI runs 
+ * concurrently. Points are created, and all snippets are inserted and 
+ * committed in one insertion set, on this thread.
  */ 
 void
 InstrumentClient::instrumentMemoryAccessInternal(
     const unique_ptr<BPatch_addressSpace>& addrSpacePtr,
     vector<BPatch_function*>& funcVec) {   
+  vector<FunctionAnalysis> analysisResults(funcVec.size());
+  {
+    PhaseTimer timer("convert functions");
+    for (size_t i = 0; i < funcVec.size(); ++i) {
+      auto& analysis = analysisResults[i];
+      analysis.function = funcVec[i];
+      analysis.parseFunction = ParseAPI::convert(funcVec[i]);
+      if (analysis.parseFunction) {
+        // finalizes a lazily parsed function here rather than in a worker
+        analysis.parseFunction->blocks();
+      }
+    }
+  }
+  {
+    PhaseTimer timer("analyze functions");
+    analyzeFunctions(analysisResults);
+  }
+  LOG(INFO) << "decoding: " << decodeNanos_.load() / 1e9 
+            << " s (summed over " << numThreads_ << " threads)";
+  if (analysisCache_) {
+    updateAnalysisCache(analysisResults);
+  }
+  {
+    PhaseTimer timer("create points");
+    uint64_t numPruned = 0;
+    for (auto& analysis : analysisResults) {
+      if (analysis.decoded) {
+        numPruned += createInstrumentPoints(analysis);
+      } else {
+        numPruned += analyzeFunctionPoints(analysis);
+      }
+    }
+    if (!prunableInstns_.empty()) {
+      LOG(INFO) << "pruned " << numPruned 
+                << " points using instruction profile";
+    }
+  }
+  {
+    PhaseTimer timer("insert snippets");
+    addrSpacePtr->beginInsertionSet();
+    for (const auto& analysis : analysisResults) {
+      insertSnippet(addrSpacePtr, analysis.instrumentPoints);
+    }
+  }
+  {
+    PhaseTimer timer("commit insertion set");
+    if (!addrSpacePtr->finalizeInsertionSet(true)) {
+      LOG(FATAL) << "error in batch insertion of snippets";
+    }
+  }
+  if (analysisCache_) {
+    analysisCache_->save();
+  }
+}
+
+/*
+ * Record the analysis of all hashed functions in the analysis cache and 
+ * report the cache hit rate.
+ */
+void
+InstrumentClient::updateAnalysisCache(
+    const vector<FunctionAnalysis>& analysisResults) {
+  uint64_t numHits = 0;
+  uint64_t numHashed = 0;
+  for (const auto& analysis : analysisResults) {
+    if (!analysis.hashed) {
+      continue;
+    }
+    numHashed++;
+    if (analysis.cacheHit) {
+      numHits++;
+    }
+    auto cachedPoints = analysis.cachedPoints;
+    analysisCache_->update(analysis.functionHash, move(cachedPoints));
+  }
+  LOG(INFO) << "analysis cache hits: " << numHits << " of " << numHashed 
+            << " functions";
+}
+
+/*
+ * Read instruction profiles written by romp library runs with ROMP_PROFILE 
+ * set. `profilePaths` is a comma separated list, counters of the same 
+ * instruction are summed over all profiles. An instruction is prunable if it
+ * never touched shared data. Reads of shared data are kept even if they never
+ * met a write of another task, since writes of the initial task leave no 
+ * access history and the data may well have been mutated.
+ */
+void
+InstrumentClient::loadInstnProfiles(const string& profilePaths) {
+  // number of shared data accesses of each profiled instruction
+  unordered_map<uint64_t, uint64_t> entries;
+  stringstream pathStream(profilePaths);
+  string path;
+  while (getline(pathStream, path, ',')) {
+    ifstream input(path);
+    if (!input.is_open()) {
+      LOG(FATAL) << "cannot open instruction profile: " << path;
+    }
+    string line;
+    while (getline(input, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      stringstream lineStream(line);
+      uint64_t instnAddr, numChecks, numSerial, numPrivate, numShared, 
+               numConflicts, numRaces;
+      bool isWrite;
+      lineStream >> hex >> instnAddr >> dec >> numChecks >> numSerial 
+                 >> numPrivate >> numShared >> numConflicts >> numRaces 
+                 >> isWrite;
+      if (!lineStream) {
+        LOG(FATAL) << "malformed line in instruction profile " << path 
+                   << ": " << line;
+      }
+      entries[instnAddr] += numShared;
+    }
+  }
+  for (const auto& entry : entries) {
+    if (entry.second == 0) {
+      prunableInstns_.insert(entry.first);
+    }
+  }
+  LOG(INFO) << prunableInstns_.size() << " of " << entries.size() 
+            << " profiled instructions are prunable";
+}
+
+/*
+ * Distribute functions over `numThreads_` workers. Each worker grabs the next
+ * unanalyzed function and stores the result in the slot of the function, so 
+ * the insertion order stays the same as in the function vector.
+ */
+void
+InstrumentClient::analyzeFunctions(vector<FunctionAnalysis>& analysisResults) {
+  atomic_size_t nextFunction(0);
+  auto worker = [&]() {
+    while (true) {
+      auto index = nextFunction.fetch_add(1, memory_order_relaxed);
+      if (index >= analysisResults.size()) {
+        break;
+      }
+      analyzeFunction(analysisResults[index]);
+    }
+  };
+  vector<thread> workers;
+  for (int i = 1; i < numThreads_; ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : workers) {
+    t.join();
+  }
+}
+
+/*
+ * Decide for each load/store instruction of the function if and how it 
+ * should be instrumented. If the analysis cache holds decisions for the 
+ * function's code bytes, the function is not decoded. Runs on the worker 
+ * threads and reads only ParseAPI and InstructionAPI objects.
+ */
+void
+InstrumentClient::analyzeFunction(FunctionAnalysis& analysis) {
+  if (!analysis.parseFunction) {
+    return;
+  }
+  if (analysisCache_ && AnalysisCache::hashFunction(analysis.parseFunction, 
+              analysis.functionHash, analysis.entryAddress)) {
+    analysis.hashed = true;
+    auto cachedPoints = analysisCache_->lookup(analysis.functionHash);
+    if (cachedPoints) {
+      analysis.cachedPoints = *cachedPoints;
+      analysis.cacheHit = true;
+      analysis.decoded = true;
+      return;
+    }
+  }
+  auto decodeStart = chrono::steady_clock::now();
+  analysis.decoded = decodeFunction(analysis);
+  decodeNanos_ += chrono::duration_cast<chrono::nanoseconds>(
+          chrono::steady_clock::now() - decodeStart).count();
+}
+
+/*
+ * Return true if a memory operand of the instruction is addressed through 
+ * the fs segment, which holds the thread local storage.
+ */
+static bool accessesThreadLocalStorage(
+        const InstructionAPI::Instruction& instruction) {
+  vector<InstructionAPI::Operand> operands;
+  instruction.getOperands(operands);
+  for (const auto& operand : operands) {
+    if (!operand.readsMemory() && !operand.writesMemory()) {
+      continue;
+    }
+    set<InstructionAPI::RegisterAST::Ptr> registers;
+    operand.getReadSet(registers);
+    for (const auto& reg : registers) {
+      if (reg->getID() == x86_64::fs || reg->getID() == x86::fs) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Decode every block of the function and record a decision for each 
+ * instruction accessing memory, ordered by offset from the function entry.
+ * Return false if the code bytes of a block are not available.
+ */
+bool
+InstrumentClient::decodeFunction(FunctionAnalysis& analysis) {
+  auto parseFunction = analysis.parseFunction;
+  auto isrc = parseFunction->isrc();
+  analysis.entryAddress = parseFunction->addr();
+  auto& cachedPoints = analysis.cachedPoints;
+  cachedPoints.clear();
+  for (auto block : parseFunction->blocks()) {
+    auto bytes = isrc->getPtrToInstruction(block->start());
+    if (!bytes) {
+      cachedPoints.clear();
+      return false;
+    }
+    InstructionAPI::InstructionDecoder decoder(bytes, 
+            block->end() - block->start(), isrc->getArch());
+    auto address = block->start();
+    for (auto instruction = decoder.decode(); instruction.isValid(); 
+         instruction = decoder.decode()) {
+      auto offset = address - analysis.entryAddress;
+      address += instruction.size();
+      if (!instruction.readsMemory() && !instruction.writesMemory()) {
+        continue;
+      }
+      // sometimes an access is both a read and a write, treat it as a write
+      auto isWrite = instruction.writesMemory();
+      if (instruction.getOperation().format().compare(0, 8, 
+                  "prefetch") == 0) {
+        cachedPoints.emplace_back(offset, eSkipPrefetch, false, false);
+      } else if (accessesThreadLocalStorage(instruction)) {
+        cachedPoints.emplace_back(offset, eSkipThreadPrivate, isWrite, false);
+      } else {
+        cachedPoints.emplace_back(offset, eInstrument, isWrite, 
+                hasHardwareLock(instruction, arch_));
+      }
+    }
+  }
+  sort(cachedPoints.begin(), cachedPoints.end(), 
+       [](const CachedPoint& a, const CachedPoint& b) {
+         return a.offset < b.offset;
+       });
+  return true;
+}
+
+/*
+ * Classify the memory access at a BPatch load/store point the way BPatch 
+ * does. Return false if the point is not instrumented: prefetches, accesses
+ * of unknown type and thread private accesses through the fs register. 
+ * Accesses that both read and write are treated as writes.
+ */
+static bool classifyMemoryAccess(BPatch_point* point, bool& isWrite) {
+  auto memoryAccess = point->getMemoryAccess();
+  if (!memoryAccess) {
+    LOG(FATAL) << "null memory access";
+  }
+  if (memoryAccess->isAPrefetch_NP()) {
+    return false;
+  }  
+  if (memoryAccess->isAStore()) { // is a store
+    isWrite = true; 
+  } else if (memoryAccess->isALoad()) { // is a pure load
+    isWrite = false;
+  } else {
+    LOG(WARNING) << "unknown memory access type in function: " 
+                 << point->getCalledFunctionName();
+    return false;
+  }
+  auto addrSpec = memoryAccess->getStartAddr(0);
+  if (addrSpec->getReg(0) == 0xffffffff && 
+      addrSpec->getReg(1) == 0xffffffff && 
+      addrSpec->getReg(2) == 0) {
+    // the memory access is a thread private one: uses fs register
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Look up the BPatch points of the instructions to instrument, except the 
+ * prunable ones. The decoded decisions only preselect instructions, each 
+ * point is classified by BPatch as well, so the instrumented points are the
+ * ones `analyzeFunctionPoints` would find. Runs on one thread, since BPatch
+ * keeps per address space point maps which are not thread safe. Return the
+ * number of pruned points.
+ */
+uint64_t
+InstrumentClient::createInstrumentPoints(FunctionAnalysis& analysis) {
+  uint64_t numPruned = 0;
+  auto appImage = addrSpacePtr_->getImage();
+  for (const auto& cachedPoint : analysis.cachedPoints) {
+    if (cachedPoint.decision != eInstrument) {
+      continue;
+    }
+    auto address = analysis.entryAddress + cachedPoint.offset;
+    if (prunableInstns_.find(address) != prunableInstns_.end()) {
+      numPruned++;
+      continue;
+    }
+    vector<BPatch_point*> points;
+    appImage->findPoints(address, points);
+    if (points.empty() || !points[0]->getMemoryAccess()) {
+      LOG(WARNING) << "no load/store point at " << hex << address << dec 
+                   << " in function " << analysis.function->getName();
+      continue;
+    }
+    auto isWrite = true;
+    if (!classifyMemoryAccess(points[0], isWrite)) {
+      continue;
+    }
+    analysis.instrumentPoints.emplace_back(points[0], 
+            reinterpret_cast<void*>(address), cachedPoint.hardWareLock, 
+            isWrite);
+  }
+  return numPruned;
+}
+
+/*
+ * Find the load/store points of a function whose code bytes could not be 
+ * decoded through BPatch, and decide for each point if and how it should 
+ * be instrumented. Runs on one thread. Return the number of pruned points.
+ */
+uint64_t
+InstrumentClient::analyzeFunctionPoints(FunctionAnalysis& analysis) {
+  uint64_t numPruned = 0;
+  auto function = analysis.function;
   BPatch_Set<BPatch_opCode> opcodes;
   opcodes.insert(BPatch_opLoad);
   opcodes.insert(BPatch_opStore);
-  addrSpacePtr->beginInsertionSet();
-  for (const auto& function : funcVec) {
-    auto pointsVecPtr = function->findPoint(opcodes);
-    if (!pointsVecPtr) {
-      LOG(WARNING) << "no load/store points for function " 
-          << function->getName();    
+  auto pointsVecPtr = function->findPoint(opcodes);
+  if (!pointsVecPtr) {
+    LOG(WARNING) << "no load/store points for function " 
+        << function->getName();    
+    return numPruned;
+  } else if (pointsVecPtr->size() == 0) {
+    LOG(WARNING) << "load/store points vector size is 0 for function " 
+        << function->getName();
+    return numPruned;
+  }
+  for (const auto& point : *pointsVecPtr) {
+    auto isWrite = true;
+    if (!classifyMemoryAccess(point, isWrite)) {
       continue;
-    } else if (pointsVecPtr->size() == 0) {
-      LOG(WARNING) << "load/store points vector size is 0 for function " 
-          << function->getName();
+    }
+    auto instnAddr = reinterpret_cast<uint64_t>(point->getAddress());
+    if (prunableInstns_.find(instnAddr) != prunableInstns_.end()) {
+      numPruned++;
       continue;
     }
-    insertSnippet(addrSpacePtr, pointsVecPtr);
-  }
-  if (!addrSpacePtr->finalizeInsertionSet(true)) {
-    LOG(FATAL) << "error in batch insertion of snippets";
+    auto instruction = point->getInsnAtPoint();
+    auto hardWareLock = hasHardwareLock(instruction, arch_);
+    analysis.instrumentPoints.emplace_back(point, point->getAddress(), 
+            hardWareLock, isWrite);
   }
+  return numPruned;
 }
 
 /* 
@@ -162,63 +654,40 @@ InstrumentClient::hasHardwareLock(
 }
 
 /*
- * Insert checkAccess code snippet to load/store point
+ * Insert checkAccess code snippet to analyzed load/store points. If the 
+ * check enabled word is available, the call is guarded by an inline test of
+ * the word, so accesses outside parallel regions skip the call.
  */
 void
 InstrumentClient::insertSnippet(
         const unique_ptr<BPatch_addressSpace>& addrSpacePtr,
-        const vector<BPatch_point*>* pointsVecPtr) {
-  if (!pointsVecPtr) {
-    LOG(FATAL) << "null pointer";
-  } 
-  for (const auto& point : *pointsVecPtr) {
-    auto memoryAccess = point->getMemoryAccess();
-    if (!memoryAccess) {
-      LOG(FATAL) << "null memory access";
-    }
-    
-    if (memoryAccess->isAPrefetch_NP()) {
-      LOG(INFO) << "current point is a prefetch, continue";
-      continue;
-    }  
-    auto isWrite = true;
-    // sometimes an access is both a read and a write 
-    // for this case, treat it as a write
-    if (memoryAccess->isAStore()) { // is a store
-      isWrite = true; 
-    } else if (memoryAccess->isALoad()) { // is a pure load
-      isWrite = false;
-    } else {
-      LOG(WARNING) << "unknown memory access type in function: " 
-                   << point->getCalledFunctionName();
-      continue;
-    }
-
-    auto addrSpec = memoryAccess->getStartAddr(0);
-    if (addrSpec->getReg(0) == 0xffffffff && 
-        addrSpec->getReg(1) == 0xffffffff && 
-        addrSpec->getReg(2) == 0) {
-      // the memory access is a thread private one: uses fs register
-      continue;
-    }
-    auto instructionAddress = point->getAddress();         
-    auto instruction = point->getInsnAtPoint();
-    auto hardWareLock = hasHardwareLock(instruction, arch_);
-
+        const vector<InstrumentPoint>& instrumentPoints) {
+  for (const auto& instrumentPoint : instrumentPoints) {
     vector<BPatch_snippet*> funcArgs;
     // memory address 
     funcArgs.push_back(new BPatch_effectiveAddressExpr()); 
     // number of bytes accessed
     funcArgs.push_back(new BPatch_bytesAccessedExpr());    
     // address of instruction
-    funcArgs.push_back(new BPatch_constExpr(instructionAddress)); 
+    funcArgs.push_back(new BPatch_constExpr(
+                instrumentPoint.instructionAddress)); 
     // instruction contains hardware lock or not
-    funcArgs.push_back(new BPatch_constExpr(hardWareLock));
+    funcArgs.push_back(new BPatch_constExpr(instrumentPoint.hardWareLock));
     // is write access or not
-    funcArgs.push_back(new BPatch_constExpr(isWrite));
+    funcArgs.push_back(new BPatch_constExpr(instrumentPoint.isWrite));
     BPatch_funcCallExpr checkAccessCall(*(checkAccessFuncs_[0]), funcArgs);
-    if (!addrSpacePtr->insertSnippet(
-                checkAccessCall, *point, BPatch_callBefore)) {
+    BPatchSnippetHandle* handle = nullptr;
+    if (checkEnabledVar_) {
+      BPatch_boolExpr isCheckEnabled(BPatch_ne, *checkEnabledVar_, 
+              BPatch_constExpr(0));
+      BPatch_ifExpr guardedCheckAccessCall(isCheckEnabled, checkAccessCall);
+      handle = addrSpacePtr->insertSnippet(guardedCheckAccessCall, 
+              *instrumentPoint.point, BPatch_callBefore);
+    } else {
+      handle = addrSpacePtr->insertSnippet(checkAccessCall, 
+              *instrumentPoint.point, BPatch_callBefore);
+    }
+    if (!handle) {
         LOG(FATAL) << "snippet insertion failed";
     }
   }
@@ -1,6 +1,10 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <regex>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "BPatch.h"
@@ -8,43 +12,145 @@
 #include "BPatch_function.h"
 #include "BPatch_point.h"
 #include "BPatch_process.h"
+#include "CFG.h"
+
+#include "AnalysisCache.h"
 
 #define MODULE_NAME_LENGTH 128
 
 namespace romp {
+  /*
+   * Load/store point to instrument. Points are created on one thread from
+   * the decisions of the analysis workers and consumed by the serial 
+   * snippet insertion.
+   */
+  typedef struct InstrumentPoint {
+    InstrumentPoint(BPatch_point* point,
+                    void* instructionAddress,
+                    bool hardWareLock,
+                    bool isWrite):
+                          point(point),
+                          instructionAddress(instructionAddress),
+                          hardWareLock(hardWareLock),
+                          isWrite(isWrite) {}
+    BPatch_point* point;
+    void* instructionAddress;
+    bool hardWareLock;
+    bool isWrite;
+  } InstrumentPoint;
+
+  /*
+   * Analysis result of one function. `cachedPoints` holds the decisions for
+   * all load/store points and is written back to the analysis cache. 
+   * `decoded` is false if the code bytes of the function are not available,
+   * such a function is analyzed through BPatch on one thread.
+   */
+  typedef struct FunctionAnalysis {
+    FunctionAnalysis(): function(nullptr), parseFunction(nullptr),
+                        entryAddress(0), functionHash(0), hashed(false), 
+                        cacheHit(false), decoded(false) {}
+    BPatch_function* function;
+    Dyninst::ParseAPI::Function* parseFunction;
+    Dyninst::Address entryAddress;
+    uint64_t functionHash;
+    bool hashed;
+    bool cacheHit;
+    bool decoded;
+    std::vector<CachedPoint> cachedPoints;
+    std::vector<InstrumentPoint> instrumentPoints;
+  } FunctionAnalysis;
+
+  /*
+   * Comma separated regular expressions selecting modules and functions to
+   * instrument. Shared libraries are only instrumented if they match
+   * `includeModules`. If `includeFunctions` is not empty, only matching
+   * functions are instrumented. Exclusions always win.
+   */
+  typedef struct InstrumentFilters {
+    std::string includeModules;
+    std::string excludeModules;
+    std::string includeFunctions;
+    std::string excludeFunctions;
+  } InstrumentFilters;
+
+  /*
+   * Log the wall clock time spent in an instrumentation phase when the
+   * timer goes out of scope.
+   */
+  class PhaseTimer {
+    public:
+      PhaseTimer(const std::string& phaseName);
+      ~PhaseTimer();
+    private:
+      std::string phaseName_;
+      std::chrono::steady_clock::time_point start_;
+  };
+
   class InstrumentClient {
     public:
       InstrumentClient(
-              const std::string& programName, 
+              const std::string& programName,
               const std::string& rompLibPath,
               std::shared_ptr<BPatch> bpatchPtr,
               const std::string& arch,
-              const std::string& modSuffix);
-      void instrumentMemoryAccess();    
+              const std::string& modSuffix,
+              int numThreads,
+              const std::string& analysisCachePath,
+              const std::string& profilePaths,
+              bool inlineGuard,
+              const InstrumentFilters& filters);
+      void instrumentMemoryAccess();
     private:
       std::unique_ptr<BPatch_addressSpace> initInstrumenter(
               const std::string& programName,
-              const std::string& rompLibPath); 
+              const std::string& rompLibPath);
       std::vector<BPatch_function*> getCheckAccessFuncs(
               const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr);
+      BPatch_variableExpr* getCheckEnabledVar(
+              const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr);
       std::vector<BPatch_function*> getFunctionsVector(
-              const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr); 
+              const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr);
+      bool shouldInstrumentModule(const std::string& moduleName, 
+                                  bool isSharedLib);
+      bool shouldInstrumentFunction(BPatch_function* function);
       void instrumentMemoryAccessInternal(
               const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr,
               std::vector<BPatch_function*>& funcVec);
-      void insertSnippet(const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr, 
-                         const std::vector<BPatch_point*>* pointsVecPtr);
+      void analyzeFunctions(std::vector<FunctionAnalysis>& analysisResults);
+      void analyzeFunction(FunctionAnalysis& analysis);
+      bool decodeFunction(FunctionAnalysis& analysis);
+      uint64_t analyzeFunctionPoints(FunctionAnalysis& analysis);
+      uint64_t createInstrumentPoints(FunctionAnalysis& analysis);
+      void updateAnalysisCache(
+              const std::vector<FunctionAnalysis>& analysisResults);
+      void loadInstnProfiles(const std::string& profilePaths);
+      void insertSnippet(const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr,
+                         const std::vector<InstrumentPoint>& instrumentPoints);
       bool hasHardwareLock(
               const Dyninst::InstructionAPI::Instruction& instruction,
               const std::string& arch);
       void finishInstrumentation(
-              const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr); 
-    private:    
+              const std::unique_ptr<BPatch_addressSpace>& addrSpacePtr);
+    private:
       std::unique_ptr<BPatch_addressSpace> addrSpacePtr_;
       std::shared_ptr<BPatch> bpatchPtr_;
       std::vector<BPatch_function*> checkAccessFuncs_;
+      // romp library word tested inline before calling `checkAccess`,
+      // nullptr if calls are not guarded
+      BPatch_variableExpr* checkEnabledVar_;
       std::string programName_;
       std::string arch_;
       std::string modSuffix_;
+      int numThreads_;
+      std::unique_ptr<AnalysisCache> analysisCache_;
+      // instructions that only touched thread private data in the profiled 
+      // runs
+      std::unordered_set<uint64_t> prunableInstns_;
+      std::vector<std::regex> includeModules_;
+      std::vector<std::regex> excludeModules_;
+      std::vector<std::regex> includeFunctions_;
+      std::vector<std::regex> excludeFunctions_;
+      // decoding time summed over the analysis threads
+      std::atomic_uint64_t decodeNanos_;
   };
 }
@@ -11,6 +11,25 @@ using namespace std;
 DEFINE_string(program, "", "program to be instrumented");
 DEFINE_string(arch, "x86", "arch of the binary to be instrumented");
 DEFINE_string(modSuffix, ".inst", "suffix for name of instrumented binary");
+DEFINE_int32(numThreads, 0, "number of threads decoding functions, " 
+                            "0 means one per hardware thread");
+DEFINE_string(analysisCache, "", "file caching per function analysis results " 
+                                 "across runs, empty disables the cache");
+DEFINE_string(profile, "", "comma separated instruction profiles written by " 
+                           "runs with ROMP_PROFILE set, used to skip " 
+                           "instrumenting instructions that only touched " 
+                           "thread private data");
+DEFINE_bool(inlineGuard, true, "test romp's check enabled word inline and " 
+                               "skip checkAccess calls outside parallel " 
+                               "regions");
+DEFINE_string(includeModules, "", "comma separated regexes of shared " 
+                                  "libraries to instrument");
+DEFINE_string(excludeModules, "", "comma separated regexes of modules not " 
+                                  "to instrument");
+DEFINE_string(includeFunctions, "", "comma separated regexes of functions " 
+                                    "to instrument, empty selects all");
+DEFINE_string(excludeFunctions, "", "comma separated regexes of functions " 
+                                    "not to instrument");
 
 int main(int argc, char* argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
@@ -23,13 +42,23 @@ int main(int argc, char* argv[]) {
   if (!envRompPath) {
     LOG(FATAL) << "ROMP_PATH env var is not set";
   }  
+  InstrumentFilters filters;
+  filters.includeModules = FLAGS_includeModules;
+  filters.excludeModules = FLAGS_excludeModules;
+  filters.includeFunctions = FLAGS_includeFunctions;
+  filters.excludeFunctions = FLAGS_excludeFunctions;
   auto bpatchPtr = make_shared<BPatch>(); 
   unique_ptr<InstrumentClient> client(
      new InstrumentClient(FLAGS_program, 
                           string(envRompPath), 
                           bpatchPtr, 
                           FLAGS_arch,
-                          FLAGS_modSuffix));
+                          FLAGS_modSuffix,
+                          FLAGS_numThreads,
+                          FLAGS_analysisCache,
+                          FLAGS_profile,
+                          FLAGS_inlineGuard,
+                          filters));
   client->instrumentMemoryAccess();
   return 0;
 }
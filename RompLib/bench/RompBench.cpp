@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AccessHistory.h"
+#include "Core.h"
+#include "Label.h"
+#include "LockSet.h"
+#include "McsLock.h"
+#include "QueryFuncs.h"
+#include "ShadowMemory.h"
+#include "TaskData.h"
+#include "TaskDepGraph.h"
+#include "ThreadData.h"
+
+/*
+ * Micro benchmarks of RompLib's core data structures. The benchmarks call
+ * into libromp directly and do not need an OpenMP runtime or Dyninst. Every
+ * benchmark runs a fixed amount of work REPETITIONS times and reports the
+ * median time per operation, so numbers are comparable across runs and
+ * commits on the same machine.
+ *
+ * usage: romp-bench [name filter]
+ */
+
+#define REPETITIONS 5
+
+using namespace romp;
+
+static volatile uint64_t gSink;
+
+/*
+ * Stub for the ompt thread data query used by the duplicate access filter
+ * in `checkDataRace`. Each benchmark thread has its own thread data.
+ */
+static thread_local ThreadData tThreadData;
+static thread_local ompt_data_t tOmptThreadData;
+
+static ompt_data_t* getBenchThreadData() {
+  tOmptThreadData.ptr = &tThreadData;
+  return &tOmptThreadData;
+}
+
+/*
+ * Run `body` REPETITIONS times. `body` performs `numOps` operations. Print
+ * the median nanoseconds per operation.
+ */
+static void runBenchmark(const std::string& name, const std::string& filter,
+                         uint64_t numOps, const std::function<void()>& body) {
+  if (!filter.empty() && name.find(filter) == std::string::npos) {
+    return;
+  }
+  std::vector<double> nanosPerOp;
+  for (int i = 0; i < REPETITIONS; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count();
+    nanosPerOp.push_back(static_cast<double>(nanos) / numOps);
+  }
+  std::sort(nanosPerOp.begin(), nanosPerOp.end());
+  printf("%-40s %12.2f ns/op %12lu ops\n", name.c_str(),
+         nanosPerOp[REPETITIONS / 2], numOps);
+}
+
+/*
+ * Build the labels of two sibling implicit tasks nested in `depth` levels
+ * of parallel regions.
+ */
+static void buildSiblingLabels(int depth, std::shared_ptr<Label>& left,
+                               std::shared_ptr<Label>& right) {
+  auto parent = genInitTaskLabel();
+  for (int i = 1; i < depth; ++i) {
+    parent = genImpTaskLabel(parent.get(), 0, 4);
+  }
+  left = genImpTaskLabel(parent.get(), 1, 4);
+  right = genImpTaskLabel(parent.get(), 2, 4);
+}
+
+static void benchShadowMemory(const std::string& filter) {
+  const uint64_t numOps = 1 << 22;
+  auto shadowMemory = std::make_shared<ShadowMemory<AccessHistory>>();
+  std::vector<uint8_t> buffer(1 << 16);
+  auto base = reinterpret_cast<uint64_t>(buffer.data());
+  // touch all shadow pages once before timing
+  for (uint64_t i = 0; i < buffer.size(); ++i) {
+    shadowMemory->getShadowMemorySlot(base + i);
+  }
+  runBenchmark("shadow_slot/sequential", filter, numOps, [&]() {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < numOps; ++i) {
+      sum += reinterpret_cast<uint64_t>(shadowMemory->getShadowMemorySlot(
+                  base + (i & (buffer.size() - 1))));
+    }
+    gSink = sum;
+  });
+  // one access per shadow page over a 64 MB address range, each access 
+  // misses the thread local page cache
+  const uint64_t stride = 1 << 16;
+  const uint64_t numPages = 1 << 10;
+  for (uint64_t i = 0; i < numPages; ++i) {
+    shadowMemory->getShadowMemorySlot(base + i * stride);
+  }
+  runBenchmark("shadow_slot/strided_64k", filter, numOps, [&]() {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < numOps; ++i) {
+      sum += reinterpret_cast<uint64_t>(shadowMemory->getShadowMemorySlot(
+                  base + (i & (numPages - 1)) * stride));
+    }
+    gSink = sum;
+  });
+}
+
+static void benchLabels(const std::string& filter) {
+  const uint64_t numOps = 1 << 20;
+  for (auto depth : {2, 4, 8, 16}) {
+    std::shared_ptr<Label> left, right;
+    buildSiblingLabels(depth, left, right);
+    auto suffix = "/depth_" + std::to_string(depth);
+    runBenchmark("compare_labels" + suffix, filter, numOps, [&]() {
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < numOps; ++i) {
+        sum += compareLabels(left.get(), right.get());
+      }
+      gSink = sum;
+    });
+    runBenchmark("happens_before" + suffix, filter, numOps, [&]() {
+      uint64_t sum = 0;
+      int diffIndex = 0;
+      for (uint64_t i = 0; i < numOps; ++i) {
+        sum += happensBefore(left.get(), right.get(), diffIndex);
+      }
+      gSink = sum;
+    });
+  }
+}
+
+/*
+ * Sibling implicit tasks read one location, so the access history holds one
+ * read record per task. Then one more task reads the location repeatedly
+ * and is checked against the whole history every time.
+ */
+static void benchCheckDataRace(const std::string& filter) {
+  omptGetThreadData = &getBenchThreadData;
+  const uint64_t numOps = 1 << 16;
+  for (auto historyLen : {1, 4, 16, 64}) {
+    auto parent = genInitTaskLabel();
+    std::vector<std::unique_ptr<TaskData>> tasks;
+    for (int i = 0; i <= historyLen; ++i) {
+      auto task = std::unique_ptr<TaskData>(new TaskData());
+      task->label = genImpTaskLabel(parent.get(), i, historyLen + 1);
+      task->lockSet = nullptr;
+      tasks.push_back(std::move(task));
+    }
+    AccessHistory accessHistory;
+    uint64_t location = 0;
+    auto check = [&](TaskData* task) {
+      AllTaskInfo allTaskInfo;
+      memset(&allTaskInfo, 0, sizeof(AllTaskInfo));
+      CheckInfo checkInfo(allTaskInfo, 1, reinterpret_cast<void*>(0x400000),
+              task, ompt_task_implicit, false, false, eNonThreadPrivate);
+      checkInfo.byteAddress = reinterpret_cast<uint64_t>(&location);
+      // a new label id per access keeps the duplicate filter out of the way
+      tThreadData.labelId++;
+      checkDataRace(&accessHistory, task->label, task->lockSet, checkInfo);
+    };
+    for (int i = 0; i < historyLen; ++i) {
+      check(tasks[i].get());
+    }
+    auto reader = tasks[historyLen].get();
+    runBenchmark("check_data_race/history_" + std::to_string(historyLen),
+                 filter, numOps, [&]() {
+      for (uint64_t i = 0; i < numOps; ++i) {
+        check(reader);
+      }
+    });
+  }
+}
+
+static void benchLockSet(const std::string& filter) {
+  const uint64_t numOps = 1 << 22;
+  for (auto numLocks : {1, 2, 4}) {
+    SmallLockSet left, right;
+    for (int i = 0; i < numLocks; ++i) {
+      left.addLock(0x1000 + i);
+      right.addLock(0x2000 + i);
+    }
+    runBenchmark("has_common_lock/disjoint_" + std::to_string(numLocks),
+                 filter, numOps, [&]() {
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < numOps; ++i) {
+        sum += left.hasCommonLock(right);
+      }
+      gSink = sum;
+    });
+  }
+}
+
+/*
+ * A chain of explicit tasks with inout dependences on one variable. Every
+ * task depends on all earlier tasks, so `hasPath` towards a task outside
+ * the graph visits every node.
+ */
+static void benchTaskDepGraph(const std::string& filter) {
+  for (auto numTasks : {16, 64, 256}) {
+    std::vector<std::unique_ptr<TaskData>> tasks;
+    for (int i = 0; i < numTasks; ++i) {
+      auto task = std::unique_ptr<TaskData>(new TaskData());
+      task->expLocalId = i;
+      task->isExplicitTask = true;
+      tasks.push_back(std::move(task));
+    }
+    uint64_t variable = 0;
+    ompt_dependence_t dependence;
+    dependence.variable.ptr = &variable;
+    dependence.dependence_type = ompt_dependence_type_inout;
+    auto suffix = "/tasks_" + std::to_string(numTasks);
+    std::unique_ptr<TaskDepGraph> graph;
+    runBenchmark("task_dep_graph/add_deps" + suffix, filter, numTasks, [&]() {
+      graph.reset(new TaskDepGraph());
+      for (auto& task : tasks) {
+        graph->addDeps(dependence, task.get());
+      }
+    });
+    if (!graph) {
+      graph.reset(new TaskDepGraph());
+      for (auto& task : tasks) {
+        graph->addDeps(dependence, task.get());
+      }
+    }
+    TaskData outsider;
+    const uint64_t numOps = 1 << 10;
+    runBenchmark("task_dep_graph/has_path_miss" + suffix, filter, numOps,
+                 [&]() {
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < numOps; ++i) {
+        sum += graph->hasPath(tasks[0].get(), &outsider);
+      }
+      gSink = sum;
+    });
+  }
+}
+
+static void benchMcsLock(const std::string& filter) {
+  const uint64_t numOpsPerThread = 1 << 18;
+  auto maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    McsLock lock;
+    mcsInit(&lock);
+    uint64_t counter = 0;
+    runBenchmark("mcs_lock/threads_" + std::to_string(numThreads), filter,
+                 numOpsPerThread * numThreads, [&]() {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&]() {
+          for (uint64_t i = 0; i < numOpsPerThread; ++i) {
+            McsNode node;
+            LockGuard guard(&lock, &node);
+            counter++;
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    });
+    gSink = counter;
+  }
+}
+
+int main(int argc, char** argv) {
+  std::string filter = argc > 1 ? argv[1] : "";
+  printf("%-40s %15s %16s\n", "benchmark", "median", "operations");
+  benchShadowMemory(filter);
+  benchLabels(filter);
+  benchCheckDataRace(filter);
+  benchLockSet(filter);
+  benchTaskDepGraph(filter);
+  benchMcsLock(filter);
+  return 0;
+}
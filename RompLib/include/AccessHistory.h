@@ -17,16 +17,22 @@ class AccessHistory {
 
 public: 
   AccessHistory() : _state(0) { mcsInit(&_lock); }
+  ~AccessHistory();
   McsLock& getLock();
   std::vector<Record>* getRecords();
   void setFlag(AccessHistoryFlag flag);
   void clearFlags();
   void clearFlag(AccessHistoryFlag flag);
+  void reset();
+  uint64_t truncate(uint64_t maxLen);
+  bool hasSameHistory(const AccessHistory& other) const;
+  void copyHistory(const AccessHistory& other);
   bool dataRaceFound() const;
   bool memIsRecycled() const;
   uint64_t getState() const;
 private:
   void _initRecords();
+  void _releaseRecords();
 private:
   McsLock _lock; 
   uint64_t _state;  
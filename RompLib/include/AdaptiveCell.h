@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "AccessHistory.h"
+
+/*
+ * This header file declares the shadow slot of adaptive granularity. A cell
+ * covers eight aligned bytes. It starts coarse, with one access history for
+ * all eight bytes. The first access that does not cover the whole cell 
+ * splits it into eight byte level access histories, each inheriting the 
+ * coarse history. Shadow pages are zero initialized, a zeroed cell is a 
+ * coarse cell with an empty history.
+ */
+#define CELL_BYTES 8
+
+namespace romp {
+
+class AdaptiveCell {
+
+public:
+  ~AdaptiveCell();
+  AccessHistory& getCoarseHistory();
+  AccessHistory* getFineHistories() const;
+  bool isSplit() const;
+  void split();
+  void setFlag(AccessHistoryFlag flag);
+  void reset();
+  uint64_t truncate(uint64_t maxLen);
+  bool hasSameHistory(const AdaptiveCell& other) const;
+  void copyHistory(const AdaptiveCell& other);
+
+private:
+  AccessHistory _coarse;
+  std::atomic<AccessHistory*> _fine;
+};
+
+}
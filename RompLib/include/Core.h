@@ -49,6 +49,7 @@ bool analyzeMutualExclusion(const Record& histRecord, const Record& curRecord);
 bool analyzeRaceCondition(const Record& histRecord, const Record& curRecord, 
                           bool& isHistBeforeCur, int& diffIndex);
 bool analyzeTaskGroupSync(Label* histLabel, Label* curLabel, int index);
+bool areSerialTasks(Label* histLabel, Label* curLabel);
 
 bool dispatchAnalysis(CheckCase checkCase, Label* hist, Label* cur, int index);
 uint64_t computeExitRank(uint64_t phase);
@@ -66,4 +67,9 @@ void modifyAccessHistory(RecordManagement decision,
 
 bool isDupMemAccess(const CheckInfo& checkInfo);
 
+void checkDataRace(AccessHistory* accessHistory, 
+                   const std::shared_ptr<Label>& curLabel, 
+                   const std::shared_ptr<LockSet>& curLockSet, 
+                   const CheckInfo& checkInfo);
+
 }
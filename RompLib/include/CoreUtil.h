@@ -1,6 +1,6 @@
 #pragma once
 #include <utility>
-#include <Symtab.h>
+#include <vector>
 
 #include "DataSharing.h"
 #include "QueryFuncs.h"
@@ -16,14 +16,20 @@
 
 namespace romp {
 
+struct InstnCounters;
+
 typedef struct DataRaceInfo {
   DataRaceInfo() {}
-  DataRaceInfo(void* instnAddrPrev, void* instnAddrCur, uint64_t memAddr):
+  DataRaceInfo(void* instnAddrPrev, void* instnAddrCur, uint64_t memAddr,
+               bool prevIsWrite, bool curIsWrite):
                instnAddrPrev(instnAddrPrev), instnAddrCur(instnAddrCur), 
-               memAddr(memAddr) {}
+               memAddr(memAddr), prevIsWrite(prevIsWrite), 
+               curIsWrite(curIsWrite) {}
   void* instnAddrPrev;
   void* instnAddrCur;
   uint64_t memAddr;
+  bool prevIsWrite;
+  bool curIsWrite;
 } DataRaceInfo;
 /* 
  * Wrap all necessary information for data race checking.
@@ -44,7 +50,8 @@ typedef struct CheckInfo {
                           taskType(taskType),
                           isWrite(isWrite),
                           hwLock(hwLock),
-                          dataSharingType(dataSharingType){}
+                          dataSharingType(dataSharingType),
+                          instnCounters(nullptr) {}
   AllTaskInfo allTaskInfo;
   uint32_t bytesAccessed;
   void* instnAddr;
@@ -54,6 +61,7 @@ typedef struct CheckInfo {
   bool hwLock; 
   uint64_t byteAddress;
   DataSharingType dataSharingType;
+  InstnCounters* instnCounters; // set when instruction profiling is on
 } CheckInfo; 
 
 bool prepareAllInfo(int& taskType, 
@@ -63,13 +71,22 @@ bool prepareAllInfo(int& taskType,
                     void*& curThreadData,
                     AllTaskInfo& allTaskInfo);
 
-void reportDataRaceWithLineInfo(const DataRaceInfo& dataRaceInfo,
-                                Dyninst::SymtabAPI::Symtab* symtabHandle);
-
 void reportDataRace(void* instnAddrPrev, void* instnAddrCur, uint64_t address);
 
 void* computeAddressRangeEnd(void* baseAddr, size_t chunkSize);
 
 void incrementLabelId();
 
+void enterParallelRegion();
+
+void exitParallelRegion();
+
+bool enterSerialTask();
+
+void exitSerialTask();
+
+}
+
+extern "C" {
+extern int gRompCheckEnabled;
 }
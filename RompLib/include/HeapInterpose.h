@@ -0,0 +1,16 @@
+#pragma once
+
+/*
+ * This header file declares the switch of libromp's malloc family 
+ * interposition. libromp defines malloc, free, realloc and posix_memalign 
+ * and forwards them to glibc. Once heap reclamation is enabled, the access 
+ * histories of a heap block are released when the block is freed, so 
+ * allocation heavy applications do not grow the shadow memory without 
+ * bound. The definitions only take effect when libromp precedes libc in
+ * symbol lookup, e.g. when it is preloaded.
+ */
+namespace romp {
+
+void enableHeapReclamation();
+
+}
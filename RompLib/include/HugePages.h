@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ * This header file declares the mapping of shadow page chunks backed by
+ * 2 MB pages. Transparent huge pages are requested with madvise on a chunk
+ * aligned to 2 MB. Huge tlb pages come from the pool reserved through
+ * /proc/sys/vm/nr_hugepages; if the pool is empty, chunks fall back to
+ * transparent huge pages.
+ */
+namespace romp {
+
+#define HUGE_PAGE_BYTES (1ULL << 21)
+
+enum HugePageMode {
+  eHugePagesOff,
+  eTransparentHugePages,
+  eHugetlbPages,
+};
+
+bool parseHugePageMode(const char* name, HugePageMode& mode);
+void* mapShadowChunk(uint64_t& bytes, HugePageMode& mode);
+uint64_t countHugeBackedBytes(
+        const std::vector<std::pair<void*, uint64_t>>& chunks);
+
+}
@@ -4,12 +4,19 @@
 #include <ompt.h>
 #include <stdlib.h>
 #include <string>
-#include <Symtab.h>
 
 #include "Callbacks.h"
 #include "CoreUtil.h"
+#include "HeapInterpose.h"
+#include "InstnProfile.h"
 #include "McsLock.h"
+#include "MemoryBudget.h"
 #include "QueryFuncs.h"
+#include "RaceFilter.h"
+#include "RaceReport.h"
+#include "ShadowAccess.h"
+#include "StaticData.h"
+#include "Stats.h"
 
 /* 
  * This header file defines functions that are used 
@@ -18,14 +25,15 @@
 namespace romp{
 
 bool gOmptInitialized = false; 
-bool gDataRaceFound = false;
 bool gReportLineInfo = false;
 bool gReportAtRuntime = false;
-Dyninst::SymtabAPI::Symtab* gSymtabHandle = nullptr;
+bool gProfileInstn = false;
+bool gRecordDataRace = false;
+std::string gInstnProfilePath;
+std::string gRaceReportPath;
+std::string gStatsCsvPath;
+size_t gHotInstnTopN = 0;
 
-McsLock gDataRaceLock;
-std::atomic_int gNumDataRace = 0;
-std::vector<DataRaceInfo> gDataRaceRecords;
 
 ompt_get_task_info_t omptGetTaskInfo;
 ompt_get_parallel_info_t omptGetParallelInfo;
@@ -61,6 +69,99 @@ int omptInitialize(ompt_function_lookup_t lookup,
   if (flag != nullptr && std::string(flag) == "on") {
     gReportAtRuntime = true;
   }
+  flag = getenv("ROMP_PROFILE");
+  if (flag != nullptr && std::string(flag) != "") {
+    gProfileInstn = true;
+    gInstnProfilePath = std::string(flag);
+    LOG(INFO) << "instruction profile will be written to: " << flag;
+  }
+  flag = getenv("ROMP_HOTNESS");
+  if (flag != nullptr && std::string(flag) != "") {
+    gProfileInstn = true;
+    gHotInstnTopN = strtoull(flag, nullptr, 10);
+  }
+  flag = getenv("ROMP_REPORT_JSON");
+  if (flag != nullptr && std::string(flag) != "") {
+    gRaceReportPath = std::string(flag);
+    LOG(INFO) << "race report will be written to: " << flag;
+  }
+  auto skipRacyInstn = false;
+  flag = getenv("ROMP_SKIP_RACY_INSTN");
+  if (flag != nullptr && std::string(flag) == "on") {
+    skipRacyInstn = true;
+  }
+  uint64_t maxReportsPerPair = 0;
+  flag = getenv("ROMP_MAX_REPORTS_PER_PAIR");
+  if (flag != nullptr && std::string(flag) != "") {
+    maxReportsPerPair = strtoull(flag, nullptr, 10);
+  }
+  configureRaceFilter(skipRacyInstn, maxReportsPerPair);
+  flag = getenv("ROMP_STATS");
+  if (flag != nullptr && std::string(flag) == "on") {
+    gStatsEnabled = true;
+  }
+  flag = getenv("ROMP_STATS_CSV");
+  if (flag != nullptr && std::string(flag) != "") {
+    gStatsEnabled = true;
+    gStatsCsvPath = std::string(flag);
+  }
+  flag = getenv("ROMP_SUPPRESSION_FILE");
+  if (flag != nullptr && std::string(flag) != "") {
+    loadSuppressions(std::string(flag));
+  }
+  flag = getenv("ROMP_MEMORY_BUDGET");
+  if (flag != nullptr && std::string(flag) != "") {
+    uint64_t budgetBytes = 0;
+    if (parseMemorySize(flag, budgetBytes)) {
+      configureMemoryBudget(budgetBytes);
+    } else {
+      LOG(WARNING) << "invalid memory budget: " << flag;
+    }
+  }
+  auto granularity = eByteLevel;
+  flag = getenv("ROMP_SHADOW_GRANULARITY");
+  if (flag != nullptr && !parseGranularity(flag, granularity)) {
+    LOG(WARNING) << "unknown shadow granularity: " << flag 
+                 << ", using byte granularity";
+  }
+  ShadowConfig shadowConfig;
+  shadowConfig.granularity = granularity;
+  shadowConfig.backend = ePageBackend;
+  shadowConfig.hugePageMode = eHugePagesOff;
+  shadowConfig.pageBits = DEFAULT_SHADOW_PAGE_BITS;
+  shadowConfig.compressAfter = 0;
+  flag = getenv("ROMP_SHADOW_BACKEND");
+  if (flag != nullptr && !parseShadowBackend(flag, shadowConfig.backend)) {
+    LOG(WARNING) << "unknown shadow backend: " << flag 
+                 << ", using dense pages";
+  }
+  flag = getenv("ROMP_SHADOW_HUGEPAGES");
+  if (flag != nullptr && 
+          !parseHugePageMode(flag, shadowConfig.hugePageMode)) {
+    LOG(WARNING) << "unknown huge page mode: " << flag;
+  }
+  flag = getenv("ROMP_SHADOW_PAGE_BITS");
+  if (flag != nullptr) {
+    auto pageBits = strtoull(flag, nullptr, 10);
+    if (pageBits >= MIN_SHADOW_PAGE_BITS && 
+            pageBits <= MAX_SHADOW_PAGE_BITS) {
+      shadowConfig.pageBits = pageBits;
+    } else {
+      LOG(WARNING) << "shadow page bits out of range: " << flag;
+    }
+  }
+  flag = getenv("ROMP_SHADOW_COMPRESS");
+  if (flag != nullptr) {
+    shadowConfig.compressAfter = strtoull(flag, nullptr, 10);
+  }
+  configureShadowMemory(shadowConfig);
+  loadStaticSegments();
+  flag = getenv("ROMP_RECLAIM_HEAP");
+  if (flag != nullptr && std::string(flag) == "on") {
+    enableHeapReclamation();
+  }
+  gRecordDataRace = gReportLineInfo || !gRaceReportPath.empty();
+  startRaceReporter(gRecordDataRace, gReportAtRuntime, gReportLineInfo);
   auto ompt_set_callback = 
       (ompt_set_callback_t)lookup("ompt_set_callback");
 
@@ -93,16 +194,37 @@ int omptInitialize(ompt_function_lookup_t lookup,
  */
 void omptFinalize(ompt_data_t* toolData) {
   LOG(INFO) << "finalizing ompt";
-  if (gDataRaceFound) {
-    LOG(INFO) << "data race found: " << gNumDataRace.load() << " races";
+  stopRaceReporter();
+  auto numDataRace = getNumDataRace();
+  if (numDataRace > 0) {
+    LOG(INFO) << "data race found: " << numDataRace << " races";
+    auto racePairs = collectRacePairs();
+    if (gRecordDataRace) {
+      LOG(INFO) << racePairs.size() << " racing instruction pairs";
+    }
     if (gReportLineInfo) {
-      for (const auto& info : gDataRaceRecords) {
-        reportDataRaceWithLineInfo(info, gSymtabHandle);
-      } 
+      reportDataRacesWithLineInfo(racePairs);
+    }
+    if (!gRaceReportPath.empty()) {
+      writeJsonReport(gRaceReportPath, racePairs, numDataRace);
     }
   } else {
     LOG(INFO) << "no data race found";
+    if (!gRaceReportPath.empty()) {
+      writeJsonReport(gRaceReportPath, std::vector<RacePair>(), 0);
+    }
+  }
+  if (!gInstnProfilePath.empty()) {
+    dumpInstnProfile(gInstnProfilePath);
+  }
+  if (gHotInstnTopN > 0) {
+    reportHotInstns(gHotInstnTopN);
+  }
+  if (gStatsEnabled) {
+    addStat(eStatShadowHugeBytes, getHugeBackedShadowBytes());
+    reportStats(gStatsCsvPath);
   }
+  reportMemoryBudget();
 }
 
 }
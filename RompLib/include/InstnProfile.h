@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Record.h"
+
+/*
+ * This header file declares the per instruction profile collected when 
+ * ROMP_PROFILE or ROMP_HOTNESS is set. The profile is consumed by 
+ * InstrumentMain to skip instrumenting instructions that only touched thread
+ * private data in the profiling run. The hotness report lists 
+ * the instructions that cost the most checking.
+ */
+namespace romp {
+
+typedef struct InstnCounters {
+  InstnCounters(): numChecks(0), numSerial(0), numThreadPrivate(0), 
+                   numShared(0), numConflicts(0), numRaces(0), 
+                   bytesChecked(0), numHistoryChecks(0), historyLenSum(0),
+                   isWrite(false) {}
+  uint64_t numChecks; // number of calls to checkAccess
+  uint64_t numSerial; // number of accesses made by the initial task
+  uint64_t numThreadPrivate; // number of accesses to thread private data
+  uint64_t numShared; // number of accesses to possibly shared data
+  uint64_t numConflicts; // number of times it met an access of another task
+                         // on the same location and one of them is a write
+  uint64_t numRaces; // number of data races it is involved in
+  uint64_t bytesChecked; // bytes passed to checkAccess
+  uint64_t numHistoryChecks; // number of times it was checked against the 
+                             // access history of a location
+  uint64_t historyLenSum; // sum of history lengths it was checked against
+  bool isWrite;
+} InstnCounters;
+
+typedef std::unordered_map<uint64_t, InstnCounters> InstnCountersTable;
+
+InstnCounters& getInstnCounters(void* instnAddr);
+void profileAccessPair(const Record& histRecord, const Record& curRecord, 
+                       InstnCounters* curCounters, bool isRace);
+bool dumpInstnProfile(const std::string& profilePath);
+void reportHotInstns(size_t topN);
+
+}
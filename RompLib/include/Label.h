@@ -18,9 +18,9 @@ enum LabelCompare {
 class Label {
 
 public:
-  Label() {}
+  Label();
   Label(const Label& label);
-  ~Label() {} 
+  ~Label();
   std::string toString() const;
   void appendSegment(const std::shared_ptr<Segment>& segment);
   std::shared_ptr<Segment> popSegment();
@@ -24,6 +24,7 @@ class SmallLockSet : public LockSet {
 public:
   SmallLockSet();
   SmallLockSet(const SmallLockSet& lockset);
+  ~SmallLockSet();
   std::string toString() const override;
   std::shared_ptr<LockSet> clone() const override; 
   bool hasCommonLock(const LockSet& other) const override;
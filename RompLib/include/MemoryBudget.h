@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+/*
+ * This header file declares romp's memory budget. When a budget is set,
+ * bytes held by shadow pages, access records, labels and lock sets are 
+ * accounted. Whenever no parallel region is active and usage is above 
+ * BUDGET_EVICT_PERCENT of the budget, cold shadow pages are evicted with a 
+ * clock sweep and, if that is not enough, long access histories are 
+ * truncated. Inside a parallel region nothing can be evicted safely, so 
+ * over budget romp stops allocating shadow pages and growing histories 
+ * instead. Every eviction can hide data races, so all of them are counted 
+ * and reported at exit. Without a budget, every update is a single branch.
+ */
+namespace romp {
+
+// usage above this share of the budget triggers eviction
+#define BUDGET_EVICT_PERCENT 90
+// eviction stops once usage is below this share of the budget
+#define BUDGET_TARGET_PERCENT 75
+// records kept per access history when histories are truncated
+#define TRUNCATED_HISTORY_LEN 4
+
+enum MemoryKind {
+  eMemShadowPages = 0,
+  eMemRecords,
+  eMemLabels,
+  eMemLockSets,
+  eNumMemoryKinds,
+};
+
+enum BudgetEvent {
+  eBudgetPagesEvicted = 0,
+  eBudgetHistoriesTruncated,
+  eBudgetRecordsTruncated,
+  eBudgetAccessesSkipped, // accesses to unshadowed memory while over budget
+  eBudgetRecordsDropped, // records not added while over budget
+  eNumBudgetEvents,
+};
+
+extern bool gMemoryBudgetEnabled;
+extern std::atomic<bool> gOverMemoryBudget;
+
+void configureMemoryBudget(uint64_t budgetBytes);
+bool parseMemorySize(const char* value, uint64_t& bytes);
+void updateMemoryUsage(MemoryKind kind, int64_t bytes);
+void countBudgetEvent(BudgetEvent event, uint64_t count = 1);
+uint64_t getMemoryUsage();
+void enforceMemoryBudget();
+void reportMemoryBudget();
+
+inline void chargeMemory(MemoryKind kind, int64_t bytes) {
+  if (gMemoryBudgetEnabled) {
+    updateMemoryUsage(kind, bytes);
+  }
+}
+
+inline bool overMemoryBudget() {
+  return gMemoryBudgetEnabled && 
+         gOverMemoryBudget.load(std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * This header file declares filters that keep known races from being
+ * checked and reported over and over. Tables are fixed size open addressing
+ * hash tables, lookups and inserts are lock free. Once a table is full, new
+ * keys are not remembered and the filter degrades to checking everything.
+ * User suppressions are resolved at startup into sorted address ranges 
+ * which are never checked.
+ */
+namespace romp {
+
+/*
+ * Set of non-zero 64 bit keys.
+ */
+class ConcurrentAddrSet {
+  public:
+    ConcurrentAddrSet(uint32_t capacityBits);
+    bool insert(uint64_t key);
+    bool contains(uint64_t key) const;
+  private:
+    uint32_t capacityBits_;
+    uint64_t mask_;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots_;
+};
+
+/*
+ * Per instruction pair counters. A slot is claimed by installing the
+ * previous instruction address, the current one is published right after.
+ */
+class RacePairCounter {
+  public:
+    RacePairCounter(uint32_t capacityBits);
+    uint64_t increment(uint64_t instnPrev, uint64_t instnCur);
+  private:
+    typedef struct Slot {
+      Slot(): instnPrev(0), instnCur(0), count(0) {}
+      std::atomic<uint64_t> instnPrev;
+      std::atomic<uint64_t> instnCur;
+      std::atomic<uint64_t> count;
+    } Slot;
+    uint32_t capacityBits_;
+    uint64_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+};
+
+void configureRaceFilter(bool skipRacyInstn, uint64_t maxReportsPerPair);
+void markRacyInstns(void* instnAddrPrev, void* instnAddrCur);
+bool isRacyInstn(void* instnAddr);
+bool shouldReportRacePair(void* instnAddrPrev, void* instnAddrCur);
+bool loadSuppressions(const std::string& suppressionPath);
+bool isSuppressedInstn(void* instnAddr);
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CoreUtil.h"
+
+/*
+ * This header file declares the data race report. Races are aggregated by
+ * the pair of racing instructions, so a race on a large array is one entry
+ * with a count and an address range instead of one entry per byte.
+ * Detecting threads push the first race of a pair into their own single 
+ * producer queue and aggregate later ones in a per thread buffer. A 
+ * background reporter thread drains the queues, aggregates the pairs and 
+ * reports new pairs at runtime, so no lock is taken on the detection path.
+ * The buffers are merged when the reporter stops.
+ */
+namespace romp {
+
+typedef struct RacePair {
+  RacePair(): instnAddrPrev(nullptr), instnAddrCur(nullptr),
+              prevIsWrite(false), curIsWrite(false), count(0),
+              minAddr(UINT64_MAX), maxAddr(0) {}
+  void* instnAddrPrev;
+  void* instnAddrCur;
+  bool prevIsWrite;
+  bool curIsWrite;
+  uint64_t count; // number of memory locations the pair raced on
+  uint64_t minAddr; // lowest racing memory address
+  uint64_t maxAddr; // highest racing memory address
+} RacePair;
+
+void startRaceReporter(bool recordRaces, bool reportAtRuntime, 
+                       bool reportLineInfo);
+void stopRaceReporter();
+void recordDataRace(const DataRaceInfo& info);
+uint64_t getNumDataRace();
+std::vector<RacePair> collectRacePairs();
+void reportDataRacesWithLineInfo(const std::vector<RacePair>& racePairs);
+bool writeJsonReport(const std::string& reportPath,
+                     const std::vector<RacePair>& racePairs,
+                     uint64_t numDataRace);
+
+}
@@ -33,6 +33,7 @@ public:
   LockSet* getLockSet() const;
   void* getInstnAddr() const; 
   void* getTaskPtr() const;
+  bool operator==(const Record& other) const;
 private:
   uint8_t _state; // store state information
   std::shared_ptr<Label> _label; // task label associated with the record
@@ -21,6 +21,7 @@ enum TaskSyncType {
  */
 class Segment {
 public: 
+  Segment();
   virtual std::string toString() const = 0;
   virtual void setType(SegmentType type) = 0; 
   virtual SegmentType getType() const = 0;
@@ -49,7 +50,7 @@ public:
   virtual bool isTaskGroupSync() const = 0;
   virtual bool operator==(const Segment& rhs) const = 0;
   virtual bool operator!=(const Segment& rhs) const = 0;
-  virtual ~Segment() = default;
+  virtual ~Segment();
 };
 
 /*
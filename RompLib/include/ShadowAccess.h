@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+
+#include "HugePages.h"
+#include "ShadowMemory.h"
+
+/*
+ * This header file declares the process wide shadow memory of access 
+ * histories. Its granularity is chosen once in omptInitialize. Access 
+ * checking and recycling are instantiated for every granularity and the 
+ * configured instance is reached through a function pointer, so the hot 
+ * path never branches on the granularity.
+ */
+// bytes below the stack top covered by a thread's stack shadow
+#define MAX_STACK_SHADOW_SPAN (1ULL << 26)
+// static data segments with a preallocated shadow region
+#define MAX_STATIC_SHADOWS 8
+// application address bits translated by the first level page table
+#define SHADOW_L1_PAGE_TABLE_BITS 20
+// application address bits covered by one shadow page
+#define DEFAULT_SHADOW_PAGE_BITS 16
+#define MIN_SHADOW_PAGE_BITS 12
+#define MAX_SHADOW_PAGE_BITS 24
+
+namespace romp {
+
+typedef struct ShadowConfig {
+  Granularity granularity;
+  ShadowBackend backend;
+  HugePageMode hugePageMode;
+  uint64_t pageBits;
+  uint64_t compressAfter; // maintenance passes before a page is compressed
+
+} ShadowConfig;
+
+void configureShadowMemory(const ShadowConfig& config);
+uint64_t getHugeBackedShadowBytes();
+bool parseGranularity(const char* name, Granularity& granularity);
+bool parseShadowBackend(const char* name, ShadowBackend& backend);
+void maintainShadowMemory();
+void recycleShadowRange(uint64_t start, uint64_t end);
+void releaseShadowRange(uint64_t start, uint64_t end);
+void evictColdShadowPages(uint64_t bytesToFree);
+void truncateAccessHistories(uint64_t maxLen);
+ShadowRegion* createStackShadow(void* stackBase, void* stackTop);
+bool createStaticShadow(uint64_t start, uint64_t end);
+void destroyShadowRegion(ShadowRegion* region);
+
+}
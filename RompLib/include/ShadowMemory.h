@@ -1,50 +1,173 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "HugePages.h"
+#include "McsLock.h"
+#include "MemoryBudget.h"
+#include "Stats.h"
 
 /*
  * This header file declares ShadowMemory class template for managing shadow 
  * memory. Type T is the type of struct of access history. We use class 
  * template here to decouple the implementation of shadow memory management
- * and the actual form of access history. We assume the shadow memory works
- * on 64 bits system. So we use uint64_t to represent void*
+ * and the actual form of access history. The granularity G is a template 
+ * parameter so that address to slot translation uses constant shifts. We 
+ * assume the shadow memory works on 64 bits system. So we use uint64_t to 
+ * represent void*
  */
 #define CANONICAL_FORM_MASK 0x0000ffffffffffff
+// shadow pages mapped at once and handed to a thread's page stack
+#define SHADOW_PAGE_BATCH 8
+// application bytes covered by one line of slots in a sparse shadow page
+#define SPARSE_LINE_BYTES 64
+// lines of the first hash table of a sparse page, later tables double
+#define SPARSE_FIRST_TABLE_LINES 4
+// keys probed in one hash table before moving on to the next table
+#define SPARSE_MAX_PROBES 8
+// a hybrid sparse page using 1 / SPARSE_PROMOTE_DIVISOR of its lines turns
+// into a dense page
+#define SPARSE_PROMOTE_DIVISOR 4
+// low bit of a page table entry that points to a sparse page
+#define SPARSE_PAGE_TAG 1ULL
+// second lowest bit of a page table entry that points to a compressed page
+#define COMPRESSED_PAGE_TAG 2ULL
+// page table entry of a compressed page claimed by the thread expanding it
+#define EXPANDING_PAGE reinterpret_cast<void*>(COMPRESSED_PAGE_TAG)
+// a cold page is compressed only if it shrinks at least by this factor
+#define MIN_COMPRESSION_RATIO 4
+// most generations a page may stay untouched before it is compressed
+#define MAX_COMPRESSION_AGE 255
 namespace romp {
 
+/*
+ * Values of the reference byte kept for every shadow page. Pinned pages 
+ * belong to a shadow region, they are never evicted, pooled or freed.
+ */
+enum PageReference {
+  ePageUnreferenced = 0,
+  ePageReferenced = 1,
+  ePagePinned = 2,
+};
+
+/*
+ * Preallocated shadow of a fixed memory range such as a thread stack or a
+ * static data segment. It is a contiguous array of slots for the shadow 
+ * pages lying fully inside the range, [ownedStart, ownedEnd), committed 
+ * lazily by the kernel. These pages are installed in the page table, so 
+ * every lookup finds the same slots, while hot paths index the array 
+ * directly. `chargedBytes` is the resident part charged to the budget.
+ */
+typedef struct ShadowRegion {
+  void* slots;
+  uint64_t mapBytes;
+  uint64_t ownedStart;
+  uint64_t ownedEnd;
+  uint64_t chargedBytes;
+} ShadowRegion;
+
+/*
+ * Hash table of a sparse shadow page. It is followed by `numLines` keys, 
+ * each the index of a line in the page plus one or zero if unused, then by
+ * `numLines` lines of slots. A full table chains to a table twice as large.
+ */
+typedef struct SparseTable {
+  struct SparseTable* next;
+  uint64_t numLines;
+  uint64_t numUsed;
+} SparseTable;
+
+/*
+ * Run length encoded shadow page. It is followed by `numRuns` runs, each a
+ * slot count and one slot holding the history shared by that many 
+ * consecutive slots.
+ */
+typedef struct CompressedPage {
+  uint64_t numRuns;
+} CompressedPage;
+
+enum ShadowBackend {
+  ePageBackend, // shadow pages are dense arrays of slots
+  eHashBackend, // shadow pages are hash tables of the lines accessed
+  eHybridBackend, // hash tables turn dense once they are well filled
+};
+
 enum Granularity {
   eByteLevel,
   eWordLevel, // aligned four bytes treated as the same memory access
   eLongWordLevel, // aligned eight bytes treated as the same memory access
+  eAdaptiveLevel, // aligned eight bytes share a cell until accessed partially
 };
 
-template<typename T>
+template<typename T, Granularity G = eByteLevel>
 class ShadowMemory {
 
 public:
   ShadowMemory(const uint64_t l1PageTableBits = 20, 
                const uint64_t l2PageTableBits = 12,
-               const uint64_t numMemAddrBits = 48,
-               Granularity granularity = eByteLevel);
+               const uint64_t numMemAddrBits = 48);
 
   ~ShadowMemory();
 public:
   T* getShadowMemorySlot(const uint64_t address);
+  T* findShadowMemorySlot(const uint64_t address);
   uint64_t getNumEntriesPerPage();
+  template<typename F>
+  void forEachSlotInRange(const uint64_t start, const uint64_t end, 
+                          const F& visit);
+  template<typename F>
+  void releaseRange(const uint64_t start, const uint64_t end, 
+                    const F& resetSlot);
+  template<typename F>
+  void forEachSlot(const F& visit);
+  void enableReferenceTracking();
+  void setHugePageMode(const HugePageMode mode);
+  void setBackend(const ShadowBackend backend);
+  uint64_t promoteSparsePages();
+  void enableCompression(const uint64_t numGenerations);
+  uint64_t compressColdPages();
+  uint64_t getHugeBackedBytes();
+  uint64_t evictColdPages(const uint64_t bytesToFree);
+  ShadowRegion* mapShadowRegion(const uint64_t start, const uint64_t end);
+  void unmapShadowRegion(ShadowRegion* region);
+  void chargeShadowRegions();
+  inline T* getRegionSlot(const ShadowRegion* region, 
+                          const uint64_t address) {
+    if (address < region->ownedStart || address >= region->ownedEnd) {
+      return nullptr;
+    }
+    return static_cast<T*>(region->slots) + 
+           ((address - region->ownedStart) >> _pageOffsetShift);
+  }
+  // number of bytes of application memory mapped to one slot
+  static constexpr uint64_t getGranularityBytes() { 
+    return 1ULL << _pageOffsetShift; 
+  }
 
 private:
   uint64_t _getPageIndex(const uint64_t address);
   uint64_t _genPageIndexMask(const uint64_t numBits, const uint64_t lowZeros);
   uint64_t _getL1PageIndex(const uint64_t address);
   uint64_t _getL2PageIndex(const uint64_t address);
-  T* _getOrCreatePageForMemAddr(const uint64_t address);   
+  void* _getOrCreatePageForMemAddr(const uint64_t address);   
+  void** _getOrCreateL1Page(const uint64_t l1Index);
 
 private:
   void*** _pageTable; 
   uint64_t _numEntriesPerPage;
   uint64_t _shadowPageIndexMask;
-  uint64_t _pageOffsetShift;
+  static constexpr uint64_t _pageOffsetShift = 
+      G == eWordLevel ? 2 : 
+      (G == eLongWordLevel || G == eAdaptiveLevel ? 3 : 0);
   uint64_t _numL1PageTableEntries;
   uint64_t _numL2PageTableEntries;
   uint64_t _l1PageTableShift;
@@ -52,19 +175,140 @@ private:
   uint64_t _l2IndexMask;
 
 private: 
-  static thread_local void* _cachedShadowPage;
+  /*
+   * Every thread keeps a stack of zeroed shadow pages. An empty stack is 
+   * refilled with up to SHADOW_PAGE_BATCH released pages, or with a fresh 
+   * chunk of SHADOW_PAGE_BATCH pages mapped at once, so most page faults of
+   * the shadow take neither a lock nor a system call.
+   */
+  static thread_local ShadowMemory* _localPagesOwner;
+  static thread_local void* _localPages[SHADOW_PAGE_BATCH];
+  static thread_local uint64_t _numLocalPages;
   static thread_local void** _cachedL1Page;
-  void* _getShadowPage(const uint64_t numEntriesPerPage);
+  void* _getShadowPage();
+  void _refillLocalPages();
   void** _getL1Page(const uint64_t numL2PageTableEntries);
   void _saveShadowPage(void* shadowPage);
   void _saveL1Page(void** l1Page);
+
+private:
+  /*
+   * Released shadow pages. Their memory is handed back to the kernel, they
+   * only hold address space until they are reused. `_chunks` lists every 
+   * mapped chunk of pages, which are unmapped with the shadow memory.
+   */
+  McsLock _pagePoolLock;
+  std::vector<void*> _pagePool;
+  std::vector<std::pair<void*, uint64_t>> _chunks;
+  uint64_t _pageBytes;
+  bool _canDiscardPages;
+  std::atomic<HugePageMode> _hugePageMode;
+  void _poolShadowPage(void* shadowPage);
+  uint64_t _releasePage(void* page);
+
+private:
+  /*
+   * Sparse shadow pages hold slots only for the lines accessed, so a page 
+   * with a handful of live bytes costs a few kilobytes instead of a dense 
+   * page. Page table entries of sparse pages carry SPARSE_PAGE_TAG. Slots 
+   * never move while accesses are checked, a hybrid page turns dense only 
+   * in `promoteSparsePages`.
+   */
+  ShadowBackend _backend;
+  uint64_t _numLinesPerPage;
+  static constexpr uint64_t _slotsPerLine = 
+      SPARSE_LINE_BYTES >> _pageOffsetShift;
+  static bool _isSparsePage(const void* page) {
+    return reinterpret_cast<uint64_t>(page) & SPARSE_PAGE_TAG;
+  }
+  static SparseTable* _getSparseTable(const void* page) {
+    return reinterpret_cast<SparseTable*>(
+            reinterpret_cast<uint64_t>(page) & ~SPARSE_PAGE_TAG);
+  }
+  static uint64_t* _getSparseKeys(SparseTable* table) {
+    return reinterpret_cast<uint64_t*>(table + 1);
+  }
+  static T* _getSparseLine(SparseTable* table, const uint64_t pos) {
+    return reinterpret_cast<T*>(_getSparseKeys(table) + table->numLines) + 
+           pos * _slotsPerLine;
+  }
+  static uint64_t _getSparseTableBytes(const uint64_t numLines) {
+    return sizeof(SparseTable) + numLines * sizeof(uint64_t) + 
+           numLines * _slotsPerLine * sizeof(T);
+  }
+  void* _createPage();
+  void _discardPage(void* page);
+  SparseTable* _newSparseTable(const uint64_t numLines);
+  T* _findSparseSlot(const void* page, const uint64_t pageIndex, 
+                     const bool create);
+  template<typename F>
+  void _forEachPageSlot(void* page, const uint64_t firstIndex, 
+                        const uint64_t lastIndex, const F& visit);
+
+private:
+  /*
+   * Dense pages untouched for `_compressAfter` maintenance passes are run 
+   * length encoded. Each l1 page is followed by one age byte per shadow 
+   * page after the reference bytes, counting the passes since the page was
+   * last looked up. A lookup that finds a compressed page claims its entry
+   * by swapping in EXPANDING_PAGE and expands it, lookups of the same page 
+   * wait for the dense page while other pages are expanded in parallel.
+   */
+  uint64_t _compressAfter;
+  static constexpr uint64_t _runBytes = sizeof(uint64_t) + sizeof(T);
+  static bool _isCompressedPage(const void* page) {
+    return reinterpret_cast<uint64_t>(page) & COMPRESSED_PAGE_TAG;
+  }
+  static CompressedPage* _getCompressedPage(const void* page) {
+    return reinterpret_cast<CompressedPage*>(
+            reinterpret_cast<uint64_t>(page) & ~COMPRESSED_PAGE_TAG);
+  }
+  static uint64_t _getCompressedBytes(const CompressedPage* compressed) {
+    return sizeof(CompressedPage) + compressed->numRuns * _runBytes;
+  }
+  uint8_t* _getAgeBytes(void** l1Page);
+  void* _compressPage(T* page);
+  void* _expandPage(void** pageEntry);
+
+private:
+  /*
+   * Clock state for evicting cold shadow pages. Each l1 page is followed by
+   * one reference byte per shadow page, set on lookup while tracking is on
+   * and cleared by the sweep. `_l1Indices` lists the installed l1 pages in
+   * the sweep order.
+   */
+  bool _trackReferences;
+  McsLock _l1IndicesLock;
+  std::vector<uint64_t> _l1Indices;
+  uint64_t _clockL1Pos;
+  uint64_t _clockL2Index;
+  uint8_t* _getReferenceBytes(void** l1Page);
+  void _markReferenced(void** l1Page, const uint64_t l2Index);
+  void _registerL1Page(const uint64_t l1Index);
+
+private:
+  /*
+   * Mapped shadow regions. Their arrays are committed as they are written,
+   * so the resident bytes are charged to the budget at quiescent points.
+   */
+  McsLock _regionsLock;
+  std::vector<ShadowRegion*> _regions;
+  bool _getRegionResidency(const ShadowRegion* region, 
+                           std::vector<unsigned char>& residency);
 };
 
-template<typename T>
-thread_local void* ShadowMemory<T>::_cachedShadowPage = nullptr;
+template<typename T, Granularity G>
+thread_local ShadowMemory<T, G>* ShadowMemory<T, G>::_localPagesOwner = 
+    nullptr;
 
-template<typename T>
-thread_local void** ShadowMemory<T>::_cachedL1Page = nullptr;
+template<typename T, Granularity G>
+thread_local void* ShadowMemory<T, G>::_localPages[SHADOW_PAGE_BATCH];
+
+template<typename T, Granularity G>
+thread_local uint64_t ShadowMemory<T, G>::_numLocalPages = 0;
+
+template<typename T, Granularity G>
+thread_local void** ShadowMemory<T, G>::_cachedL1Page = nullptr;
 
 
 /*
@@ -82,30 +326,11 @@ thread_local void** ShadowMemory<T>::_cachedL1Page = nullptr;
  * with one entry. For long word level granularity, every aligned eight bytes 
  * are associated with one entry.
  */
-template<typename T>
-ShadowMemory<T>::ShadowMemory(const uint64_t l1PageTableBits,
-                              const uint64_t l2PageTableBits,
-                              const uint64_t numMemAddrBits, 
-                              Granularity granularity) {
-  uint64_t lowZeroMask = 0;
-  switch(granularity) {
-    case eByteLevel:
-      lowZeroMask = 0;
-      _pageOffsetShift = 0;
-      break;
-    case eWordLevel:
-      lowZeroMask = 2;
-      _pageOffsetShift = 2;
-      break;
-    case eLongWordLevel:
-      lowZeroMask = 3;
-      _pageOffsetShift = 3;
-      break;
-    default:
-      lowZeroMask = 0;
-      _pageOffsetShift = 0;
-      break;
-  }
+template<typename T, Granularity G>
+ShadowMemory<T, G>::ShadowMemory(const uint64_t l1PageTableBits,
+                                 const uint64_t l2PageTableBits,
+                                 const uint64_t numMemAddrBits) {
+  const uint64_t lowZeroMask = _pageOffsetShift;
   _l1PageTableShift = numMemAddrBits - l1PageTableBits;  
   _l2PageTableShift = _l1PageTableShift - l2PageTableBits; 
   _l2IndexMask = (1 << l2PageTableBits) - 1;
@@ -116,6 +341,22 @@ ShadowMemory<T>::ShadowMemory(const uint64_t l1PageTableBits,
 
   _numL1PageTableEntries = 1 << l1PageTableBits;
   _numL2PageTableEntries = 1 << l2PageTableBits;
+
+  mcsInit(&_pagePoolLock);
+  _pageBytes = sizeof(T) * _numEntriesPerPage;
+  // pages not aligned to os pages cannot be discarded, they are zeroed
+  _canDiscardPages = _pageBytes % sysconf(_SC_PAGESIZE) == 0;
+  _hugePageMode.store(eHugePagesOff, std::memory_order_relaxed);
+  _backend = ePageBackend;
+  _compressAfter = 0;
+  _numLinesPerPage = std::max<uint64_t>(1, 
+          _numEntriesPerPage / _slotsPerLine);
+
+  _trackReferences = false;
+  mcsInit(&_l1IndicesLock);
+  mcsInit(&_regionsLock);
+  _clockL1Pos = 0;
+  _clockL2Index = 0;
      
   // For l1PageTableBits = 20, this allocates a chunk of memory of size 
   // 2^20 * 8 = 8 Mb, which is managable.
@@ -124,22 +365,32 @@ ShadowMemory<T>::ShadowMemory(const uint64_t l1PageTableBits,
     LOG(FATAL) << "cannot create page table";
   }
   _pageTable = static_cast<void***>(tmp); 
+  chargeMemory(eMemShadowPages, sizeof(void**) * _numL1PageTableEntries);
 }
 
-template<typename T>
-ShadowMemory<T>::~ShadowMemory() {
-  // we should explicitly delete the shadow page
+template<typename T, Granularity G>
+ShadowMemory<T, G>::~ShadowMemory() {
+  // shadow pages live in chunks, pinned pages belong to shadow regions
   for (int i = 0; i < _numL1PageTableEntries; ++i) {
     if (_pageTable[i] != 0) {
       for (int j = 0; j < _numL2PageTableEntries; ++j) {
-        if (_pageTable[i][j] != 0) {
-          free(_pageTable[i][j]); //free the leaf shadow page
+        if (_isSparsePage(_pageTable[i][j])) {
+          for (auto table = _getSparseTable(_pageTable[i][j]); table;) {
+            auto next = table->next;
+            free(table);
+            table = next;
+          }
+        } else if (_isCompressedPage(_pageTable[i][j])) {
+          free(_getCompressedPage(_pageTable[i][j]));
         }
       }
       free(_pageTable[i]);
     }
   }
   free(_pageTable);
+  for (auto& chunk : _chunks) {
+    munmap(chunk.first, chunk.second);
+  }
 }
 
 /* 
@@ -149,8 +400,8 @@ ShadowMemory<T>::~ShadowMemory() {
  * [48, 64] (lowest bit as bit 1), are copies of bit 47. One should first
  * mask out bits [48, 64] to avoid overflow of first level page index.
  */
-template<typename T>
-uint64_t ShadowMemory<T>::_getL1PageIndex(const uint64_t address) {  
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::_getL1PageIndex(const uint64_t address) {  
   return static_cast<uint64_t>((address & CANONICAL_FORM_MASK) >> 
           _l1PageTableShift);
 }
@@ -159,19 +410,22 @@ uint64_t ShadowMemory<T>::_getL1PageIndex(const uint64_t address) {
  * Get the index to the second level page table, using the middle field of 
  * the address.
  */
-template<typename T>
-uint64_t ShadowMemory<T>::_getL2PageIndex(const uint64_t address) {
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::_getL2PageIndex(const uint64_t address) {
   return static_cast<uint64_t>((address >> _l2PageTableShift) & _l2IndexMask);
 }
 
 /*
  * Given the memory address, return the corresponding slot in shadow memory.
  */
-template<typename T>
-T* ShadowMemory<T>::getShadowMemorySlot(const uint64_t address) {
-  auto pageBase = _getOrCreatePageForMemAddr(address);   
+template<typename T, Granularity G>
+T* ShadowMemory<T, G>::getShadowMemorySlot(const uint64_t address) {
+  auto page = _getOrCreatePageForMemAddr(address);   
   auto pageIndex = _getPageIndex(address); 
-  return static_cast<T*>(pageBase + pageIndex);
+  if (_isSparsePage(page)) {
+    return _findSparseSlot(page, pageIndex, true);
+  }
+  return static_cast<T*>(page) + pageIndex;
 }
 
 
@@ -179,9 +433,30 @@ T* ShadowMemory<T>::getShadowMemorySlot(const uint64_t address) {
  * Given the memory address, return the shadow page containing the access 
  * history slot that is associated with the address.
  */
-template<typename T>
-T* ShadowMemory<T>::_getOrCreatePageForMemAddr(const uint64_t address) {
+template<typename T, Granularity G>
+void* ShadowMemory<T, G>::_getOrCreatePageForMemAddr(const uint64_t address) {
   auto l1Index = _getL1PageIndex(address);
+  _getOrCreateL1Page(l1Index);
+  // now get the shadow page
+  auto l2Index = _getL2PageIndex(address);
+  if (_pageTable[l1Index][l2Index] == 0) {
+    auto freshShadowPage = _createPage();
+    auto success = __sync_bool_compare_and_swap(&_pageTable[l1Index][l2Index],
+                                             0, freshShadowPage);
+    if (!success) {
+      _discardPage(freshShadowPage);
+    }
+  }
+  _markReferenced(_pageTable[l1Index], l2Index);
+  auto page = _pageTable[l1Index][l2Index];
+  if (_isCompressedPage(page)) {
+    page = _expandPage(&_pageTable[l1Index][l2Index]);
+  }
+  return page;
+}
+
+template<typename T, Granularity G>
+void** ShadowMemory<T, G>::_getOrCreateL1Page(const uint64_t l1Index) {
   if (_pageTable[l1Index] == 0) { 
     // the first level page is not allocated yet.
     auto freshL1Page = _getL1Page(_numL2PageTableEntries);
@@ -190,30 +465,119 @@ T* ShadowMemory<T>::_getOrCreatePageForMemAddr(const uint64_t address) {
     if (!success) { // someone has already allocated this slot
       RAW_DLOG(INFO, "saving l1 page to cache");
       _saveL1Page(freshL1Page);
+    } else {
+      _registerL1Page(l1Index);
     }
   }
-  // now get the shadow page
+  return _pageTable[l1Index];
+}
+
+/*
+ * Like getShadowMemorySlot, but return nullptr instead of allocating pages.
+ */
+template<typename T, Granularity G>
+T* ShadowMemory<T, G>::findShadowMemorySlot(const uint64_t address) {
+  auto l1Page = _pageTable[_getL1PageIndex(address)];
+  if (l1Page == nullptr) {
+    return nullptr;
+  }
   auto l2Index = _getL2PageIndex(address);
-  if (_pageTable[l1Index][l2Index] == 0) {
-    auto freshShadowPage = _getShadowPage(_numEntriesPerPage);
-    auto success = __sync_bool_compare_and_swap(&_pageTable[l1Index][l2Index],
-                                             0, freshShadowPage);
-    if (!success) {
-      _saveShadowPage(freshShadowPage);
+  auto page = l1Page[l2Index];
+  if (page == nullptr) {
+    return nullptr;
+  }
+  _markReferenced(l1Page, l2Index);
+  if (_isCompressedPage(page)) {
+    page = _expandPage(&l1Page[l2Index]);
+  }
+  if (_isSparsePage(page)) {
+    return _findSparseSlot(page, _getPageIndex(address), false);
+  }
+  return static_cast<T*>(page) + _getPageIndex(address);
+}
+
+
+/*
+ * Call `visit` on every slot of application memory range [start, end] 
+ * whose shadow page exists. Ranges without shadow pages have no access 
+ * history, they are skipped page by page without allocating anything.
+ */
+template<typename T, Granularity G>
+template<typename F>
+void ShadowMemory<T, G>::forEachSlotInRange(const uint64_t start, 
+                                            const uint64_t end,
+                                            const F& visit) {
+  const uint64_t pageSpan = 1ULL << _l2PageTableShift;
+  auto address = start;
+  while (address <= end) {
+    auto pageEnd = address | (pageSpan - 1);
+    auto l1Page = _pageTable[_getL1PageIndex(address)];
+    auto page = l1Page ? l1Page[_getL2PageIndex(address)] : nullptr;
+    if (_isCompressedPage(page)) {
+      page = _expandPage(&l1Page[_getL2PageIndex(address)]);
+    }
+    if (page) {
+      _forEachPageSlot(page, _getPageIndex(address), 
+                       _getPageIndex(std::min(pageEnd, end)), visit);
     }
+    if (pageEnd >= end) {
+      break;
+    }
+    address = pageEnd + 1;
   }
-  return static_cast<T*>(_pageTable[l1Index][l2Index]);
 }
 
+/*
+ * Release the access histories of application memory range [start, end], 
+ * which the application no longer owns. Shadow pages fully covered by the 
+ * range are detached from the page table, cleared and kept for reuse. 
+ * Slots on partially covered pages are passed to `resetSlot`. The caller 
+ * guarantees that no other thread checks accesses to the range.
+ */
+template<typename T, Granularity G>
+template<typename F>
+void ShadowMemory<T, G>::releaseRange(const uint64_t start, 
+                                      const uint64_t end,
+                                      const F& resetSlot) {
+  const uint64_t pageSpan = 1ULL << _l2PageTableShift;
+  auto address = start;
+  while (address <= end) {
+    auto pageStart = address & ~(pageSpan - 1);
+    auto pageEnd = pageStart | (pageSpan - 1);
+    auto l1Page = _pageTable[_getL1PageIndex(address)];
+    auto pageEntry = l1Page ? &l1Page[_getL2PageIndex(address)] : nullptr;
+    auto page = pageEntry ? *pageEntry : nullptr;
+    if (page == EXPANDING_PAGE) {
+      page = _expandPage(pageEntry);
+    }
+    auto pinned = page && 
+        _getReferenceBytes(l1Page)[_getL2PageIndex(address)] == ePagePinned;
+    if (page && !pinned && pageStart >= start && pageEnd <= end) {
+      if (__sync_bool_compare_and_swap(pageEntry, page, nullptr)) {
+        _releasePage(page);
+      }
+    } else if (page) {
+      if (_isCompressedPage(page)) {
+        page = _expandPage(pageEntry);
+      }
+      _forEachPageSlot(page, _getPageIndex(address), 
+                       _getPageIndex(std::min(pageEnd, end)), resetSlot);
+    }
+    if (pageEnd >= end) {
+      break;
+    }
+    address = pageEnd + 1;
+  }
+}
 
-template<typename T>
-uint64_t ShadowMemory<T>::_getPageIndex(const uint64_t address) {
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::_getPageIndex(const uint64_t address) {
   return (address & _shadowPageIndexMask) >> _pageOffsetShift;
 }
 
 
-template<typename T>
-uint64_t ShadowMemory<T>::getNumEntriesPerPage() {
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::getNumEntriesPerPage() {
   return _numEntriesPerPage;
 }
 
@@ -221,49 +585,762 @@ uint64_t ShadowMemory<T>::getNumEntriesPerPage() {
  * Helper function to get an allocation of l1 page, which is a array of 
  * pointers to shadow pages. Use thread local storage for a caching.
  */
-template<typename T>
-void** ShadowMemory<T>::_getL1Page(uint64_t numL2PageTableEntries) {
+template<typename T, Granularity G>
+void** ShadowMemory<T, G>::_getL1Page(uint64_t numL2PageTableEntries) {
   void** result = nullptr;
   if (_cachedL1Page != nullptr) {
     result = _cachedL1Page;
     _cachedL1Page = nullptr;
   } else {
-    // no cached l1 page available, create one
-    auto tmp = calloc(1, sizeof(void*) * numL2PageTableEntries);
+    // no cached l1 page available, create one, followed by reference and 
+    // age bytes
+    auto bytes = (sizeof(void*) + 2) * numL2PageTableEntries;
+    auto tmp = calloc(1, bytes);
     if (tmp == NULL) {
       RAW_LOG(FATAL, "%s\n", "cannot allocate l1 page"); 
     }
+    chargeMemory(eMemShadowPages, bytes);
     result = static_cast<void**>(tmp);
   }
   return result;
 }
 
 /*
- * Helper function to get an allocation of shadow page, which contains 
- * entries of access history type T. 
+ * Helper function to get a zeroed shadow page, which contains entries of 
+ * access history type T, from the thread's page stack. Pages left on the 
+ * stack by another shadow memory instance are dropped, they stay in that 
+ * instance's chunks.
  */
-template<typename T>
-void* ShadowMemory<T>::_getShadowPage(const uint64_t numEntriesPerPage) {
-  void* result;
-  if (_cachedShadowPage != nullptr) {
-    result = _cachedShadowPage;
-    _cachedShadowPage = nullptr;
-  } else { 
-    auto tmp = calloc(1, sizeof(T) * numEntriesPerPage);
-    if (tmp == NULL) {
-      RAW_LOG(FATAL, "%s\n", "cannot allocate shadowpage");
+template<typename T, Granularity G>
+void* ShadowMemory<T, G>::_getShadowPage() {
+  if (_localPagesOwner != this) {
+    _localPagesOwner = this;
+    _numLocalPages = 0;
+  }
+  if (_numLocalPages == 0) {
+    _refillLocalPages();
+  }
+  chargeMemory(eMemShadowPages, _pageBytes);
+  return _localPages[--_numLocalPages];
+}
+
+/*
+ * Refill the empty page stack with released pages. If there are none, map
+ * a chunk of SHADOW_PAGE_BATCH pages. The kernel commits the chunk lazily,
+ * so pages never touched cost only address space. A chunk rounded up to 
+ * huge pages has room for more pages, they go to the pool.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_refillLocalPages() {
+  {
+    McsNode node;
+    LockGuard guard(&_pagePoolLock, &node);
+    while (_numLocalPages < SHADOW_PAGE_BATCH && !_pagePool.empty()) {
+      _localPages[_numLocalPages++] = _pagePool.back();
+      _pagePool.pop_back();
     }
-    result = static_cast<void*>(tmp);
   }
-  return result;
+  if (_numLocalPages > 0) {
+    addStat(eStatShadowPagesReused, _numLocalPages);
+    return;
+  }
+  uint64_t chunkBytes = _pageBytes * SHADOW_PAGE_BATCH;
+  auto oldMode = _hugePageMode.load(std::memory_order_relaxed);
+  auto mode = oldMode;
+  auto chunk = static_cast<char*>(mapShadowChunk(chunkBytes, mode));
+  if (chunk == nullptr) {
+    RAW_LOG(FATAL, "%s\n", "cannot allocate shadowpage");
+  }
+  if (mode != oldMode) {
+    // keep the downgrade only if no other thread changed the mode meanwhile
+    _hugePageMode.compare_exchange_strong(oldMode, mode, 
+            std::memory_order_relaxed);
+  }
+  auto numPages = chunkBytes / _pageBytes;
+  {
+    McsNode node;
+    LockGuard guard(&_pagePoolLock, &node);
+    _chunks.emplace_back(chunk, chunkBytes);
+    for (auto i = SHADOW_PAGE_BATCH; i < numPages; ++i) {
+      _pagePool.push_back(chunk + i * _pageBytes);
+    }
+  }
+  addStat(eStatShadowChunks);
+  addStat(eStatShadowPages, numPages);
+  // the lowest page ends up on top of the stack
+  for (auto i = SHADOW_PAGE_BATCH; i > 0; --i) {
+    _localPages[_numLocalPages++] = chunk + (i - 1) * _pageBytes;
+  }
+}
+
+/*
+ * Destroy the access histories on a detached shadow page, hand its memory 
+ * back to the kernel and keep it for `_refillLocalPages`. A discarded page
+ * reads as zeros when it is touched again.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_poolShadowPage(void* shadowPage) {
+  auto slots = static_cast<T*>(shadowPage);
+  for (uint64_t i = 0; i < _numEntriesPerPage; ++i) {
+    slots[i].~T();
+  }
+  if (!_canDiscardPages || 
+      madvise(shadowPage, _pageBytes, MADV_DONTNEED) != 0) {
+    memset(shadowPage, 0, _pageBytes);
+  }
+  addStat(eStatShadowPagesReleased);
+  chargeMemory(eMemShadowPages, -static_cast<int64_t>(_pageBytes));
+  McsNode node;
+  LockGuard guard(&_pagePoolLock, &node);
+  _pagePool.push_back(shadowPage);
+}
+
+/*
+ * Destroy the access histories of a page detached from the page table and
+ * free it. Return the number of bytes freed.
+ */
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::_releasePage(void* page) {
+  if (_isCompressedPage(page)) {
+    auto compressed = _getCompressedPage(page);
+    auto run = reinterpret_cast<char*>(compressed + 1);
+    for (uint64_t i = 0; i < compressed->numRuns; ++i, run += _runBytes) {
+      reinterpret_cast<T*>(run + sizeof(uint64_t))->~T();
+    }
+    auto bytesFreed = _getCompressedBytes(compressed);
+    free(compressed);
+    addStat(eStatShadowPagesReleased);
+    chargeMemory(eMemShadowPages, -static_cast<int64_t>(bytesFreed));
+    return bytesFreed;
+  }
+  if (!_isSparsePage(page)) {
+    _poolShadowPage(page);
+    return _pageBytes;
+  }
+  uint64_t bytesFreed = 0;
+  for (auto table = _getSparseTable(page); table;) {
+    auto keys = _getSparseKeys(table);
+    for (uint64_t pos = 0; pos < table->numLines; ++pos) {
+      if (keys[pos] == 0) {
+        continue;
+      }
+      auto line = _getSparseLine(table, pos);
+      for (uint64_t i = 0; i < _slotsPerLine; ++i) {
+        line[i].~T();
+      }
+    }
+    auto next = table->next;
+    bytesFreed += _getSparseTableBytes(table->numLines);
+    free(table);
+    table = next;
+  }
+  addStat(eStatShadowPagesReleased);
+  chargeMemory(eMemShadowPages, -static_cast<int64_t>(bytesFreed));
+  return bytesFreed;
+}
+
+/*
+ * Return a fresh page of the configured backend, tagged if it is sparse.
+ */
+template<typename T, Granularity G>
+void* ShadowMemory<T, G>::_createPage() {
+  if (_backend == ePageBackend) {
+    return _getShadowPage();
+  }
+  auto table = _newSparseTable(std::min<uint64_t>(SPARSE_FIRST_TABLE_LINES, 
+                                                  _numLinesPerPage));
+  return reinterpret_cast<void*>(
+          reinterpret_cast<uint64_t>(table) | SPARSE_PAGE_TAG);
+}
+
+/*
+ * Drop a fresh page that lost the race to be installed.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_discardPage(void* page) {
+  if (_isSparsePage(page)) {
+    _releasePage(page);
+  } else {
+    _saveShadowPage(page);
+  }
+}
+
+template<typename T, Granularity G>
+SparseTable* ShadowMemory<T, G>::_newSparseTable(const uint64_t numLines) {
+  auto bytes = _getSparseTableBytes(numLines);
+  auto table = static_cast<SparseTable*>(calloc(1, bytes));
+  if (table == nullptr) {
+    RAW_LOG(FATAL, "%s\n", "cannot allocate sparse shadow page");
+  }
+  table->numLines = numLines;
+  addStat(eStatSparseTables);
+  chargeMemory(eMemShadowPages, bytes);
+  return table;
+}
+
+/*
+ * Return the slot at `pageIndex` of a sparse page. A line is looked up by 
+ * linear probing from its index in the page. Keys are only ever added, so 
+ * an empty key ends the search. If `create` is set, a missing line is 
+ * claimed at the first empty key, otherwise nullptr is returned.
+ */
+template<typename T, Granularity G>
+T* ShadowMemory<T, G>::_findSparseSlot(const void* page, 
+                                       const uint64_t pageIndex, 
+                                       const bool create) {
+  auto lineIndex = pageIndex / _slotsPerLine;
+  auto key = lineIndex + 1;
+  auto offset = pageIndex % _slotsPerLine;
+  auto table = _getSparseTable(page);
+  while (true) {
+    auto keys = _getSparseKeys(table);
+    auto mask = table->numLines - 1;
+    auto numProbes = std::min<uint64_t>(SPARSE_MAX_PROBES, table->numLines);
+    auto pos = lineIndex & mask;
+    for (uint64_t probe = 0; probe < numProbes; ++probe) {
+      auto current = __atomic_load_n(&keys[pos], __ATOMIC_ACQUIRE);
+      if (current == 0) {
+        if (!create) {
+          return nullptr;
+        }
+        if (__sync_bool_compare_and_swap(&keys[pos], 0, key)) {
+          __atomic_add_fetch(&table->numUsed, 1, __ATOMIC_RELAXED);
+          return _getSparseLine(table, pos) + offset;
+        }
+        current = __atomic_load_n(&keys[pos], __ATOMIC_ACQUIRE);
+      }
+      if (current == key) {
+        return _getSparseLine(table, pos) + offset;
+      }
+      pos = (pos + 1) & mask;
+    }
+    auto next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);
+    if (next == nullptr) {
+      if (!create) {
+        return nullptr;
+      }
+      auto fresh = _newSparseTable(std::min(table->numLines * 2, 
+                                            _numLinesPerPage));
+      if (__sync_bool_compare_and_swap(&table->next, nullptr, fresh)) {
+        next = fresh;
+      } else {
+        chargeMemory(eMemShadowPages, 
+                -static_cast<int64_t>(_getSparseTableBytes(fresh->numLines)));
+        free(fresh);
+        next = __atomic_load_n(&table->next, __ATOMIC_ACQUIRE);
+      }
+    }
+    table = next;
+  }
+}
+
+/*
+ * Call `visit` on the existing slots of `page` with page index in
+ * [firstIndex, lastIndex]. Slots of lines a sparse page does not hold are
+ * skipped.
+ */
+template<typename T, Granularity G>
+template<typename F>
+void ShadowMemory<T, G>::_forEachPageSlot(void* page, 
+                                          const uint64_t firstIndex,
+                                          const uint64_t lastIndex,
+                                          const F& visit) {
+  if (!_isSparsePage(page)) {
+    for (auto index = firstIndex; index <= lastIndex; ++index) {
+      visit(static_cast<T*>(page) + index);
+    }
+    return;
+  }
+  for (auto table = _getSparseTable(page); table; table = table->next) {
+    auto keys = _getSparseKeys(table);
+    for (uint64_t pos = 0; pos < table->numLines; ++pos) {
+      if (keys[pos] == 0) {
+        continue;
+      }
+      auto lineStart = (keys[pos] - 1) * _slotsPerLine;
+      auto first = std::max(firstIndex, lineStart);
+      auto last = std::min(lastIndex, lineStart + _slotsPerLine - 1);
+      if (first > last) {
+        continue;
+      }
+      auto line = _getSparseLine(table, pos);
+      for (auto index = first; index <= last; ++index) {
+        visit(line + index - lineStart);
+      }
+    }
+  }
+}
+
+/*
+ * Map a shadow region for application memory [start, end] and install its 
+ * shadow pages in the page table. Only pages lying fully inside the range 
+ * are mapped, they replace any stale page, e.g. left by an earlier thread 
+ * on the same stack. Pages at the ends may be shared with neighbouring 
+ * memory and outlive the region, so they stay with the page table. Return
+ * nullptr if no page lies inside or the array cannot be mapped.
+ */
+template<typename T, Granularity G>
+ShadowRegion* ShadowMemory<T, G>::mapShadowRegion(const uint64_t start,
+                                                  const uint64_t end) {
+  const uint64_t pageSpan = 1ULL << _l2PageTableShift;
+  const uint64_t pageBytes = sizeof(T) * _numEntriesPerPage;
+  auto mapStart = (start + pageSpan - 1) & ~(pageSpan - 1);
+  auto mapEnd = (end + 1) & ~(pageSpan - 1);
+  if (mapStart >= mapEnd) {
+    return nullptr;
+  }
+  auto mapBytes = (mapEnd - mapStart) / pageSpan * pageBytes;
+  auto slots = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, 
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (slots == MAP_FAILED) {
+    RAW_LOG(WARNING, "cannot map shadow region of %lu bytes", mapBytes);
+    return nullptr;
+  }
+  auto region = new ShadowRegion();
+  region->slots = slots;
+  region->mapBytes = mapBytes;
+  region->ownedStart = mapStart;
+  region->ownedEnd = mapEnd;
+  region->chargedBytes = 0;
+  for (auto address = mapStart; address < mapEnd; address += pageSpan) {
+    auto l1Page = _getOrCreateL1Page(_getL1PageIndex(address));
+    auto l2Index = _getL2PageIndex(address);
+    auto slice = static_cast<char*>(slots) + 
+                 (address - mapStart) / pageSpan * pageBytes;
+    auto wasPinned = _getReferenceBytes(l1Page)[l2Index] == ePagePinned;
+    auto stale = __atomic_load_n(&l1Page[l2Index], __ATOMIC_ACQUIRE);
+    // a page being expanded is replaced once it is dense
+    while (stale == EXPANDING_PAGE || 
+           !__atomic_compare_exchange_n(&l1Page[l2Index], &stale, 
+                   static_cast<void*>(slice), false, __ATOMIC_ACQ_REL, 
+                   __ATOMIC_ACQUIRE)) {
+      if (stale == EXPANDING_PAGE) {
+        stale = _expandPage(&l1Page[l2Index]);
+      }
+    }
+    if (stale && !wasPinned) {
+      _releasePage(stale);
+    }
+    _getReferenceBytes(l1Page)[l2Index] = ePagePinned;
+  }
+  McsNode node;
+  LockGuard guard(&_regionsLock, &node);
+  _regions.push_back(region);
+  return region;
+}
+
+/*
+ * Remove the pages of `region` from the page table, destroy the access
+ * histories on its resident pages, discharge it and unmap it. Non resident 
+ * pages were never written, so they hold no records.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::unmapShadowRegion(ShadowRegion* region) {
+  const uint64_t pageSpan = 1ULL << _l2PageTableShift;
+  const uint64_t pageBytes = sizeof(T) * _numEntriesPerPage;
+  {
+    McsNode node;
+    LockGuard guard(&_regionsLock, &node);
+    _regions.erase(std::find(_regions.begin(), _regions.end(), region));
+  }
+  for (auto address = region->ownedStart; 
+          address < region->ownedEnd; address += pageSpan) {
+    auto l1Page = _pageTable[_getL1PageIndex(address)];
+    auto l2Index = _getL2PageIndex(address);
+    auto slice = static_cast<char*>(region->slots) + 
+                 (address - region->ownedStart) / pageSpan * pageBytes;
+    if (__sync_bool_compare_and_swap(&l1Page[l2Index], slice, nullptr)) {
+      _getReferenceBytes(l1Page)[l2Index] = ePageUnreferenced;
+    }
+  }
+  const uint64_t osPageBytes = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> residency;
+  auto slots = static_cast<T*>(region->slots);
+  auto numSlots = region->mapBytes / sizeof(T);
+  if (_getRegionResidency(region, residency)) {
+    for (uint64_t i = 0; i < residency.size(); ++i) {
+      if ((residency[i] & 1) == 0) {
+        continue;
+      }
+      // slots starting on this os page
+      auto first = (i * osPageBytes + sizeof(T) - 1) / sizeof(T);
+      auto last = std::min(((i + 1) * osPageBytes + sizeof(T) - 1) / 
+                           sizeof(T), numSlots);
+      for (auto index = first; index < last; ++index) {
+        slots[index].~T();
+      }
+    }
+  } else {
+    RAW_LOG(WARNING, "cannot query shadow region residency");
+  }
+  chargeMemory(eMemShadowPages, -static_cast<int64_t>(region->chargedBytes));
+  munmap(region->slots, region->mapBytes);
+  delete region;
+}
+
+/*
+ * Charge the resident bytes of every shadow region to the memory budget. 
+ * Called at quiescent points, between them the charge of a region lags 
+ * behind the stack pages it has touched since.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::chargeShadowRegions() {
+  if (!gMemoryBudgetEnabled) {
+    return;
+  }
+  const uint64_t osPageBytes = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> residency;
+  McsNode node;
+  LockGuard guard(&_regionsLock, &node);
+  for (auto region : _regions) {
+    if (!_getRegionResidency(region, residency)) {
+      continue;
+    }
+    uint64_t residentBytes = 0;
+    for (auto resident : residency) {
+      residentBytes += (resident & 1) * osPageBytes;
+    }
+    chargeMemory(eMemShadowPages, static_cast<int64_t>(residentBytes) - 
+                 static_cast<int64_t>(region->chargedBytes));
+    region->chargedBytes = residentBytes;
+  }
+}
+
+template<typename T, Granularity G>
+bool ShadowMemory<T, G>::_getRegionResidency(
+        const ShadowRegion* region, std::vector<unsigned char>& residency) {
+  const uint64_t osPageBytes = sysconf(_SC_PAGESIZE);
+  residency.resize((region->mapBytes + osPageBytes - 1) / osPageBytes);
+  return mincore(region->slots, region->mapBytes, residency.data()) == 0;
+}
+
+template<typename T, Granularity G>
+uint8_t* ShadowMemory<T, G>::_getReferenceBytes(void** l1Page) {
+  return reinterpret_cast<uint8_t*>(l1Page + _numL2PageTableEntries);
+}
+
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_markReferenced(void** l1Page, 
+                                         const uint64_t l2Index) {
+  if (_trackReferences) {
+    auto referenced = _getReferenceBytes(l1Page) + l2Index;
+    if (__atomic_load_n(referenced, __ATOMIC_RELAXED) == ePageUnreferenced) {
+      __atomic_store_n(referenced, ePageReferenced, __ATOMIC_RELAXED);
+    }
+  }
+  if (_compressAfter > 0) {
+    auto age = _getAgeBytes(l1Page) + l2Index;
+    if (__atomic_load_n(age, __ATOMIC_RELAXED) != 0) {
+      __atomic_store_n(age, 0, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+template<typename T, Granularity G>
+uint8_t* ShadowMemory<T, G>::_getAgeBytes(void** l1Page) {
+  return _getReferenceBytes(l1Page) + _numL2PageTableEntries;
+}
+
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_registerL1Page(const uint64_t l1Index) {
+  McsNode node;
+  LockGuard guard(&_l1IndicesLock, &node);
+  _l1Indices.push_back(l1Index);
+}
+
+/*
+ * From now on, every shadow page lookup marks the page as referenced.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::enableReferenceTracking() {
+  _trackReferences = true;
+}
+
+/*
+ * Back chunks mapped from now on with huge pages, which saves tlb misses 
+ * on the shadow of large arrays.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::setHugePageMode(const HugePageMode mode) {
+  _hugePageMode.store(mode, std::memory_order_relaxed);
+}
+
+/*
+ * Choose the representation of shadow pages created from now on.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::setBackend(const ShadowBackend backend) {
+  _backend = backend;
+}
+
+/*
+ * Turn every hybrid sparse page using at least 1 / SPARSE_PROMOTE_DIVISOR
+ * of its lines into a dense page, which is smaller and faster to look up.
+ * Slots are moved bit by bit, so this must only be called while no access
+ * is being checked. Return the number of promoted pages.
+ */
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::promoteSparsePages() {
+  if (_backend != eHybridBackend) {
+    return 0;
+  }
+  uint64_t numPromoted = 0;
+  McsNode node;
+  LockGuard guard(&_l1IndicesLock, &node);
+  for (auto l1Index : _l1Indices) {
+    auto l1Page = _pageTable[l1Index];
+    for (uint64_t l2Index = 0; l2Index < _numL2PageTableEntries; ++l2Index) {
+      auto page = l1Page[l2Index];
+      if (!_isSparsePage(page)) {
+        continue;
+      }
+      uint64_t numUsed = 0;
+      for (auto table = _getSparseTable(page); table; table = table->next) {
+        numUsed += table->numUsed;
+      }
+      if (numUsed * SPARSE_PROMOTE_DIVISOR < _numLinesPerPage) {
+        continue;
+      }
+      auto densePage = static_cast<T*>(_getShadowPage());
+      for (auto table = _getSparseTable(page); table;) {
+        auto keys = _getSparseKeys(table);
+        for (uint64_t pos = 0; pos < table->numLines; ++pos) {
+          if (keys[pos] != 0) {
+            memcpy(static_cast<void*>(densePage + 
+                                      (keys[pos] - 1) * _slotsPerLine), 
+                   _getSparseLine(table, pos), _slotsPerLine * sizeof(T));
+          }
+        }
+        auto next = table->next;
+        chargeMemory(eMemShadowPages, 
+                -static_cast<int64_t>(_getSparseTableBytes(table->numLines)));
+        free(table);
+        table = next;
+      }
+      l1Page[l2Index] = densePage;
+      numPromoted++;
+    }
+  }
+  addStat(eStatSparsePromotions, numPromoted);
+  return numPromoted;
+}
+
+/*
+ * Compress dense pages once they stay untouched for `numGenerations` calls
+ * of `compressColdPages`, at most MAX_COMPRESSION_AGE.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::enableCompression(const uint64_t numGenerations) {
+  _compressAfter = std::min<uint64_t>(numGenerations, MAX_COMPRESSION_AGE);
+}
+
+/*
+ * Age every dense page not looked up since the last call and compress the
+ * pages that reach the configured age. Slots are moved bit by bit, so this
+ * must only be called while no access is being checked. Return the number
+ * of compressed pages.
+ */
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::compressColdPages() {
+  if (_compressAfter == 0) {
+    return 0;
+  }
+  uint64_t numCompressed = 0;
+  McsNode node;
+  LockGuard guard(&_l1IndicesLock, &node);
+  for (auto l1Index : _l1Indices) {
+    auto l1Page = _pageTable[l1Index];
+    auto references = _getReferenceBytes(l1Page);
+    auto ages = _getAgeBytes(l1Page);
+    for (uint64_t l2Index = 0; l2Index < _numL2PageTableEntries; ++l2Index) {
+      auto page = l1Page[l2Index];
+      if (!page || references[l2Index] == ePagePinned || 
+              _isSparsePage(page) || _isCompressedPage(page)) {
+        continue;
+      }
+      if (++ages[l2Index] < _compressAfter) {
+        continue;
+      }
+      // a page that does not compress well is tried again a full age later
+      ages[l2Index] = 0;
+      auto compressed = _compressPage(static_cast<T*>(page));
+      if (compressed) {
+        l1Page[l2Index] = compressed;
+        numCompressed++;
+      }
+    }
+  }
+  addStat(eStatPagesCompressed, numCompressed);
+  return numCompressed;
+}
+
+/*
+ * Run length encode the histories of a detached dense page and release it.
+ * The first slot of every run is moved into the encoding, the equal ones 
+ * are destroyed with the page. Return the tagged compressed page, or 
+ * nullptr if it would not be MIN_COMPRESSION_RATIO times smaller.
+ */
+template<typename T, Granularity G>
+void* ShadowMemory<T, G>::_compressPage(T* page) {
+  uint64_t numRuns = 1;
+  for (uint64_t i = 1; i < _numEntriesPerPage; ++i) {
+    if (!page[i].hasSameHistory(page[i - 1])) {
+      numRuns++;
+    }
+  }
+  auto bytes = sizeof(CompressedPage) + numRuns * _runBytes;
+  if (bytes * MIN_COMPRESSION_RATIO > _pageBytes) {
+    return nullptr;
+  }
+  auto compressed = static_cast<CompressedPage*>(malloc(bytes));
+  if (compressed == nullptr) {
+    return nullptr;
+  }
+  compressed->numRuns = numRuns;
+  auto run = reinterpret_cast<char*>(compressed + 1);
+  uint64_t runStart = 0;
+  for (uint64_t i = 1; i <= _numEntriesPerPage; ++i) {
+    if (i < _numEntriesPerPage && page[i].hasSameHistory(page[runStart])) {
+      continue;
+    }
+    *reinterpret_cast<uint64_t*>(run) = i - runStart;
+    memcpy(run + sizeof(uint64_t), static_cast<void*>(page + runStart), 
+           sizeof(T));
+    memset(static_cast<void*>(page + runStart), 0, sizeof(T));
+    run += _runBytes;
+    runStart = i;
+  }
+  chargeMemory(eMemShadowPages, bytes);
+  _poolShadowPage(page);
+  return reinterpret_cast<void*>(
+          reinterpret_cast<uint64_t>(compressed) | COMPRESSED_PAGE_TAG);
+}
+
+/*
+ * Decode the compressed page at `pageEntry` into a dense page and install 
+ * it. The first thread claims the entry, the others finding the same page
+ * yield until the dense page is installed. Return the page now installed.
+ */
+template<typename T, Granularity G>
+void* ShadowMemory<T, G>::_expandPage(void** pageEntry) {
+  auto page = __atomic_load_n(pageEntry, __ATOMIC_ACQUIRE);
+  while (true) {
+    if (!_isCompressedPage(page)) {
+      return page;
+    }
+    if (page == EXPANDING_PAGE) {
+      std::this_thread::yield();
+      page = __atomic_load_n(pageEntry, __ATOMIC_ACQUIRE);
+    } else if (__atomic_compare_exchange_n(pageEntry, &page, EXPANDING_PAGE,
+                       false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  auto compressed = _getCompressedPage(page);
+  auto slots = static_cast<T*>(_getShadowPage());
+  auto run = reinterpret_cast<char*>(compressed + 1);
+  uint64_t index = 0;
+  for (uint64_t i = 0; i < compressed->numRuns; ++i, run += _runBytes) {
+    auto numSlots = *reinterpret_cast<uint64_t*>(run);
+    memcpy(static_cast<void*>(slots + index), run + sizeof(uint64_t), 
+           sizeof(T));
+    for (uint64_t j = 1; j < numSlots; ++j) {
+      slots[index + j].copyHistory(slots[index]);
+    }
+    index += numSlots;
+  }
+  chargeMemory(eMemShadowPages, 
+               -static_cast<int64_t>(_getCompressedBytes(compressed)));
+  free(compressed);
+  addStat(eStatPagesExpanded);
+  __atomic_store_n(pageEntry, static_cast<void*>(slots), __ATOMIC_RELEASE);
+  return slots;
+}
+
+/*
+ * Return the number of shadow page bytes the kernel backs by huge pages.
+ */
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::getHugeBackedBytes() {
+  std::vector<std::pair<void*, uint64_t>> chunks;
+  {
+    McsNode node;
+    LockGuard guard(&_pagePoolLock, &node);
+    chunks = _chunks;
+  }
+  return countHugeBackedBytes(chunks);
+}
+
+/*
+ * Call `visit` on every slot of every existing shadow page.
+ */
+template<typename T, Granularity G>
+template<typename F>
+void ShadowMemory<T, G>::forEachSlot(const F& visit) {
+  McsNode node;
+  LockGuard guard(&_l1IndicesLock, &node);
+  for (auto l1Index : _l1Indices) {
+    auto l1Page = _pageTable[l1Index];
+    for (uint64_t l2Index = 0; l2Index < _numL2PageTableEntries; ++l2Index) {
+      auto page = l1Page[l2Index];
+      // compressed pages are cold, they are not expanded for a visit
+      if (page && !_isCompressedPage(page)) {
+        _forEachPageSlot(page, 0, _numEntriesPerPage - 1, visit);
+      }
+    }
+  }
+}
+
+/*
+ * Advance the clock hand over the shadow pages for at most one lap until 
+ * `bytesToFree` bytes are freed. A page referenced 
+ * since the hand last passed gets its reference cleared, an unreferenced 
+ * page is evicted together with its access histories. Return the number of
+ * evicted pages. Must only be called while no access is being checked.
+ */
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::evictColdPages(const uint64_t bytesToFree) {
+  uint64_t bytesFreed = 0;
+  uint64_t numEvicted = 0;
+  McsNode node;
+  LockGuard guard(&_l1IndicesLock, &node);
+  if (_l1Indices.empty()) {
+    return 0;
+  }
+  auto numSteps = _l1Indices.size() * _numL2PageTableEntries;
+  for (uint64_t step = 0; step < numSteps && bytesFreed < bytesToFree; 
+          ++step) {
+    if (_clockL2Index == _numL2PageTableEntries) {
+      _clockL2Index = 0;
+      _clockL1Pos = (_clockL1Pos + 1) % _l1Indices.size();
+    }
+    auto l1Page = _pageTable[_l1Indices[_clockL1Pos]];
+    auto l2Index = _clockL2Index++;
+    auto page = l1Page[l2Index];
+    if (!page) {
+      continue;
+    }
+    auto referenced = _getReferenceBytes(l1Page) + l2Index;
+    if (*referenced == ePagePinned) {
+      continue;
+    }
+    if (*referenced == ePageReferenced) {
+      *referenced = ePageUnreferenced;
+      continue;
+    }
+    l1Page[l2Index] = nullptr;
+    bytesFreed += _releasePage(page);
+    numEvicted++;
+  }
+  return numEvicted;
 }
 
 /*
  * It is always expected that when this function is called, the cached pointer
  * is nullptr.
  */
-template<typename T>
-void ShadowMemory<T>::_saveL1Page(void** l1Page) {     
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_saveL1Page(void** l1Page) {     
   if (_cachedL1Page) {
     RAW_LOG(ERROR, "%s %lx\n", "cached l1 page is not nullptr:", _cachedL1Page);
     return;
@@ -271,13 +1348,14 @@ void ShadowMemory<T>::_saveL1Page(void** l1Page) {
   _cachedL1Page = l1Page;  
 }
 
-template<typename T>
-void ShadowMemory<T>::_saveShadowPage(void* shadowPage) {     
-  if (_cachedShadowPage) {
-    RAW_LOG(ERROR, "%s\n", "cached shadow page is not nullptr!");
-    return;
-  }
-  _cachedShadowPage = shadowPage;  
+/*
+ * Put back a page taken by `_getShadowPage` but not installed. The stack 
+ * has room for it, since the page came from it.
+ */
+template<typename T, Granularity G>
+void ShadowMemory<T, G>::_saveShadowPage(void* shadowPage) {     
+  chargeMemory(eMemShadowPages, -static_cast<int64_t>(_pageBytes));
+  _localPages[_numLocalPages++] = shadowPage;  
 }
 
 
@@ -285,8 +1363,8 @@ void ShadowMemory<T>::_saveShadowPage(void* shadowPage) {
  * Generate the mask value that is composed of `numBits` consequtive bits,
  * while masking lowest `mask` bits as 0.
  */
-template<typename T>
-uint64_t ShadowMemory<T>::_genPageIndexMask(uint64_t numBits, uint64_t lowZeros) {
+template<typename T, Granularity G>
+uint64_t ShadowMemory<T, G>::_genPageIndexMask(uint64_t numBits, uint64_t lowZeros) {
   return (1 << numBits) - (1 << lowZeros);
 }
 
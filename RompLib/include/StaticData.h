@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+/*
+ * This header file declares the lookup of the executable's static data. 
+ * The PT_LOAD segments of the executable are read once at initialization. 
+ * Read only segments (.text, .rodata) cannot be written, so accesses to 
+ * them never race and exit before any check. Writable segments (.data, 
+ * .bss) get a preallocated shadow region, so hot globals neither fault in
+ * shadow pages lazily nor walk the page table.
+ */
+namespace romp {
+
+#define MAX_READ_ONLY_SEGMENTS 8
+
+typedef struct AddressRange {
+  uint64_t start;
+  uint64_t end; // exclusive
+} AddressRange;
+
+extern int gNumReadOnlySegments;
+extern AddressRange gReadOnlySegments[MAX_READ_ONLY_SEGMENTS];
+
+void loadStaticSegments();
+
+inline bool isReadOnlyStatic(uint64_t address) {
+  for (int i = 0; i < gNumReadOnlySegments; ++i) {
+    if (address >= gReadOnlySegments[i].start && 
+            address < gReadOnlySegments[i].end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}
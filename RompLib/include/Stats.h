@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/*
+ * This header file declares romp's internal performance counters. Each
+ * thread updates its own counters without synchronization. Counters of all
+ * threads are merged at finalization into a text summary and optionally a
+ * csv file. When statistics are off, every update is a single branch.
+ */
+namespace romp {
+
+enum StatCounter {
+  eStatCheckAccess = 0,
+  eStatExitSuppressed, // suppressed or known racy instruction
+  eStatExitReadOnly, // read only static data
+  eStatExitInitialTask,
+  eStatExitThreadPrivate,
+  eStatExitRaceFound, // location already has a race reported
+  eStatExitRecycled,
+  eStatExitDupAccess,
+  eStatShadowPages, // shadow pages mapped
+  eStatShadowChunks, // chunks of shadow pages mapped
+  eStatShadowHugetlbChunks, // chunks mapped from the huge tlb page pool
+  eStatShadowHugeBytes, // shadow page bytes backed by huge pages at exit
+  eStatShadowPagesReleased, // shadow pages released on heap free
+  eStatShadowPagesReused, // released shadow pages allocated again
+  eStatHeapReclaims, // heap blocks whose access histories were released
+  eStatSparseTables, // hash tables of sparse shadow pages allocated
+  eStatSparsePromotions, // sparse shadow pages turned dense
+  eStatPagesCompressed, // cold shadow pages run length encoded
+  eStatPagesExpanded, // compressed shadow pages decoded on lookup
+  eStatCellSplits, // adaptive cells split into byte level histories
+  eStatHappensBefore, // calls to happensBefore
+  eStatHasPath, // calls to TaskDepGraph::hasPath
+  eStatHasPathNodes, // nodes visited by TaskDepGraph::hasPath
+  eStatMcsAcquire, // mcs lock acquisitions
+  eStatMcsContended, // acquisitions that had to wait
+  eStatMcsSpins, // spin iterations while waiting
+  eNumStatCounters,
+};
+
+enum StatCallback {
+  eCbCheckAccess = 0,
+  eCbImplicitTask,
+  eCbSyncRegion,
+  eCbMutexAcquired,
+  eCbMutexReleased,
+  eCbWork,
+  eCbParallelBegin,
+  eCbParallelEnd,
+  eCbTaskCreate,
+  eCbTaskSchedule,
+  eCbDependences,
+  eCbThreadBegin,
+  eCbThreadEnd,
+  eCbDispatch,
+  eCbReduction,
+  eNumStatCallbacks,
+};
+
+// history length buckets: 0, 1, 2, 3-4, 5-8, 9-16, 17-32, 33+
+#define NUM_HISTORY_LEN_BUCKETS 8
+
+typedef struct ThreadStats {
+  uint64_t counters[eNumStatCounters];
+  uint64_t callbackCalls[eNumStatCallbacks];
+  uint64_t callbackCycles[eNumStatCallbacks];
+  uint64_t historyLen[NUM_HISTORY_LEN_BUCKETS];
+} ThreadStats;
+
+extern bool gStatsEnabled;
+
+ThreadStats* getThreadStats();
+uint64_t readCycleCounter();
+void recordHistoryLength(uint64_t historyLen);
+void reportStats(const std::string& csvPath);
+
+inline void addStat(StatCounter counter, uint64_t value = 1) {
+  if (gStatsEnabled) {
+    getThreadStats()->counters[counter] += value;
+  }
+}
+
+/*
+ * Count the enclosing callback invocation and the cycles spent in it.
+ */
+class CallbackTimer {
+  public:
+    CallbackTimer(StatCallback callback): _callback(callback), _start(0) {
+      if (gStatsEnabled) {
+        _start = readCycleCounter();
+      }
+    }
+    ~CallbackTimer() {
+      if (gStatsEnabled && _start != 0) {
+        auto stats = getThreadStats();
+        stats->callbackCalls[_callback]++;
+        stats->callbackCycles[_callback] += readCycleCounter() - _start;
+      }
+    }
+  private:
+    StatCallback _callback;
+    uint64_t _start;
+};
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Dyninst {
+namespace SymtabAPI {
+class Symtab;
+}
+}
+
+/*
+ * This header file declares the symbolizer used to map instruction addresses
+ * to source lines when reporting data races. Line tables of the executable
+ * are parsed once into a sorted address index. Lookups afterwards are binary
+ * searches and can run concurrently.
+ */
+namespace romp {
+
+typedef struct SourceLocation {
+  SourceLocation(): file(nullptr), line(-1), column(-1) {}
+  const std::string* file; // interned file name, nullptr if unknown
+  int line;
+  int column;
+} SourceLocation;
+
+class Symbolizer {
+  public:
+    Symbolizer();
+    void setExecutablePath(const std::string& appPath);
+    bool open();
+    bool lookup(uint64_t instnAddr, SourceLocation& location) const;
+    void resolve(const std::vector<uint64_t>& instnAddrs,
+                 std::vector<SourceLocation>& locations) const;
+    bool findFunctionRanges(const std::string& functionName,
+            std::vector<std::pair<uint64_t, uint64_t>>& ranges) const;
+    bool findLineRanges(const std::string& fileName, int firstLine, 
+            int lastLine,
+            std::vector<std::pair<uint64_t, uint64_t>>& ranges) const;
+  private:
+    typedef struct LineEntry {
+      uint64_t start;
+      uint64_t end;
+      uint32_t fileIndex;
+      int line;
+      int column;
+    } LineEntry;
+  private:
+    std::string appPath_;
+    std::once_flag openFlag_;
+    Dyninst::SymtabAPI::Symtab* symtab_;
+    bool opened_;
+    // sorted by start address
+    std::vector<LineEntry> lineEntries_;
+    std::vector<std::string> fileNames_;
+};
+
+Symbolizer& getSymbolizer();
+
+}
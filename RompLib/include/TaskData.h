@@ -21,6 +21,7 @@ typedef struct TaskData {
   int expLocalId; // if the task is explicit, store its local id in par region
   bool isMutexTask;
   bool isExplicitTask; 
+  bool isSerialTask; // explicit task created outside of any parallel region
   TaskData() {
     label = nullptr;
     lockSet = nullptr;
@@ -29,6 +30,7 @@ typedef struct TaskData {
     expLocalId = 0;
     isMutexTask = false;
     isExplicitTask = false;
+    isSerialTask = false;
   }
 } TaskData;
 
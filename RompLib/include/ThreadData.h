@@ -5,6 +5,8 @@
 
 namespace romp {
 
+struct ShadowRegion;
+
 /*
  * ThreadData stores information about thread. The pointer to this struct
  * is stored in the runtime data structure in openmp. It could be retrieved
@@ -14,13 +16,15 @@ typedef struct ThreadData {
   void* stackBaseAddr;
   void* stackTopAddr;
   void* lowestAccessedAddr;
+  ShadowRegion* stackShadow;
   std::atomic_uint64_t labelId;
   std::unordered_map<uint64_t, uint64_t> dupReadTable;
   std::unordered_map<uint64_t, uint64_t> dupWriteTable;
   
   ThreadData() : stackBaseAddr(nullptr), 
                  stackTopAddr(nullptr), 
-                 lowestAccessedAddr((void*)ADDR_MAX) {}
+                 lowestAccessedAddr((void*)ADDR_MAX),
+                 stackShadow(nullptr) {}
 
   void setLowestAddr(void* addr) {
     lowestAccessedAddr = addr;
@@ -3,10 +3,27 @@
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+#include "MemoryBudget.h"
+
 namespace romp {
 
+AccessHistory::~AccessHistory() {
+  _releaseRecords();
+}
+
 void AccessHistory::_initRecords() {
   _records = std::make_unique<std::vector<Record>>();
+  chargeMemory(eMemRecords, sizeof(std::vector<Record>));
+}
+
+void AccessHistory::_releaseRecords() {
+  if (!_records) {
+    return;
+  }
+  auto bytes = sizeof(std::vector<Record>) + 
+          _records->capacity() * sizeof(Record);
+  chargeMemory(eMemRecords, -static_cast<int64_t>(bytes));
+  _records.reset();
 }
 
 McsLock& AccessHistory::getLock() {
@@ -37,6 +54,65 @@ void AccessHistory::clearFlags() {
   _state = 0; 
 }
 
+/*
+ * Drop the records and the flags, releasing the record storage. Called when
+ * the memory location is freed. We assume the access history is under 
+ * mutual exclusion.
+ */
+void AccessHistory::reset() {
+  _releaseRecords();
+  _state = 0;
+}
+
+/*
+ * Keep only the `maxLen` most recent records and shrink the record storage.
+ * Return the number of records dropped. Called only while no access is 
+ * being checked, so the access history is not locked.
+ */
+uint64_t AccessHistory::truncate(uint64_t maxLen) {
+  if (!_records) {
+    return 0;
+  }
+  uint64_t numDropped = 0;
+  auto oldCapacity = _records->capacity();
+  if (_records->size() > maxLen) {
+    numDropped = _records->size() - maxLen;
+    _records->erase(_records->begin(), _records->begin() + numDropped);
+  }
+  if (_records->capacity() > _records->size()) {
+    _records->shrink_to_fit();
+    auto bytesFreed = (oldCapacity - _records->capacity()) * sizeof(Record);
+    chargeMemory(eMemRecords, -static_cast<int64_t>(bytesFreed));
+  }
+  return numDropped;
+}
+
+/*
+ * Return true if `other` has the same flags and records, no matter whether 
+ * record storage is allocated for an empty history.
+ */
+bool AccessHistory::hasSameHistory(const AccessHistory& other) const {
+  auto size = _records ? _records->size() : 0;
+  auto otherSize = other._records ? other._records->size() : 0;
+  if (_state != other._state || size != otherSize) {
+    return false;
+  }
+  return size == 0 || *_records == *other._records;
+}
+
+/*
+ * Make this empty history a copy of `other`. Called only while no access 
+ * is being checked, so neither history is locked.
+ */
+void AccessHistory::copyHistory(const AccessHistory& other) {
+  _state = other._state;
+  if (other._records && !other._records->empty()) {
+    auto records = getRecords();
+    *records = *other._records;
+    chargeMemory(eMemRecords, records->capacity() * sizeof(Record));
+  }
+}
+
 bool AccessHistory::dataRaceFound() const {
   return (_state & eDataRaceFound) != 0;
 }
@@ -0,0 +1,122 @@
+#include "AdaptiveCell.h"
+
+#include "McsLock.h"
+#include "Stats.h"
+
+namespace romp {
+
+AdaptiveCell::~AdaptiveCell() {
+  delete[] _fine.load(std::memory_order_relaxed);
+}
+
+AccessHistory& AdaptiveCell::getCoarseHistory() {
+  return _coarse;
+}
+
+/*
+ * Return the eight byte level histories, or nullptr if the cell is coarse.
+ */
+AccessHistory* AdaptiveCell::getFineHistories() const {
+  return _fine.load(std::memory_order_acquire);
+}
+
+bool AdaptiveCell::isSplit() const {
+  return getFineHistories() != nullptr;
+}
+
+/*
+ * Split the cell into byte level histories. The caller holds the lock of 
+ * the coarse history, so no access is added to it during the copy. The 
+ * fine histories are published only after they are complete.
+ */
+void AdaptiveCell::split() {
+  if (isSplit()) {
+    return;
+  }
+  auto fine = new AccessHistory[CELL_BYTES];
+  auto coarseRecords = _coarse.getRecords();
+  for (int i = 0; i < CELL_BYTES; ++i) {
+    *(fine[i].getRecords()) = *coarseRecords;
+    if (_coarse.dataRaceFound()) {
+      fine[i].setFlag(eDataRaceFound);
+    }
+    if (_coarse.memIsRecycled()) {
+      fine[i].setFlag(eMemoryRecycled);
+    }
+  }
+  coarseRecords->clear();
+  coarseRecords->shrink_to_fit();
+  _fine.store(fine, std::memory_order_release);
+  addStat(eStatCellSplits);
+}
+
+/*
+ * Set the flag on the coarse history and, if the cell is split, on every 
+ * byte level history.
+ */
+void AdaptiveCell::setFlag(AccessHistoryFlag flag) {
+  {
+    McsNode node;
+    LockGuard guard(&(_coarse.getLock()), &node);
+    _coarse.setFlag(flag);
+  }
+  auto fine = getFineHistories();
+  if (!fine) {
+    return;
+  }
+  for (int i = 0; i < CELL_BYTES; ++i) {
+    McsNode node;
+    LockGuard guard(&(fine[i].getLock()), &node);
+    fine[i].setFlag(flag);
+  }
+}
+
+/*
+ * Reset the coarse history and, if the cell is split, every byte level 
+ * history. The cell stays split.
+ */
+void AdaptiveCell::reset() {
+  {
+    McsNode node;
+    LockGuard guard(&(_coarse.getLock()), &node);
+    _coarse.reset();
+  }
+  auto fine = getFineHistories();
+  if (!fine) {
+    return;
+  }
+  for (int i = 0; i < CELL_BYTES; ++i) {
+    McsNode node;
+    LockGuard guard(&(fine[i].getLock()), &node);
+    fine[i].reset();
+  }
+}
+
+/*
+ * Truncate the coarse history and every byte level history, see 
+ * AccessHistory::truncate.
+ */
+uint64_t AdaptiveCell::truncate(uint64_t maxLen) {
+  auto numDropped = _coarse.truncate(maxLen);
+  auto fine = getFineHistories();
+  if (fine) {
+    for (int i = 0; i < CELL_BYTES; ++i) {
+      numDropped += fine[i].truncate(maxLen);
+    }
+  }
+  return numDropped;
+}
+
+/*
+ * Split cells are never equal, so only coarse cells are copied.
+ */
+bool AdaptiveCell::hasSameHistory(const AdaptiveCell& other) const {
+  return !isSplit() && !other.isSplit() && 
+         _coarse.hasSameHistory(other._coarse);
+}
+
+void AdaptiveCell::copyHistory(const AdaptiveCell& other) {
+  _coarse.copyHistory(other._coarse);
+}
+
+}
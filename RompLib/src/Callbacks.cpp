@@ -9,14 +9,13 @@
 #include "Label.h"
 #include "ParRegionData.h"
 #include "QueryFuncs.h"
-#include "ShadowMemory.h"
+#include "ShadowAccess.h"
+#include "Stats.h"
 #include "TaskData.h"
 #include "ThreadData.h"
 
 namespace romp {   
 
-extern ShadowMemory<AccessHistory> shadowMemory;
-   
 void on_ompt_callback_implicit_task(
        ompt_scope_endpoint_t endPoint,
        ompt_data_t* parallelData,
@@ -24,6 +23,7 @@ void on_ompt_callback_implicit_task(
        unsigned int actualParallelism,
        unsigned int index,
        int flags) {
+  CallbackTimer timer(eCbImplicitTask);
   RAW_DLOG(INFO, "on_ompt_callback_implicit_task called:%u p:%lx t:%lx %u %u %d",
           endPoint, parallelData, taskData, actualParallelism, index, flags);
   incrementLabelId();
@@ -157,6 +157,7 @@ void on_ompt_callback_sync_region(
        ompt_data_t *parallelData,
        ompt_data_t *taskData,
        const void* codePtrRa) {
+  CallbackTimer timer(eCbSyncRegion);
   RAW_DLOG(INFO,  "on_ompt_callback_sync_region called %p %d %d", 
           taskData, kind, endPoint);
   incrementLabelId();
@@ -213,6 +214,7 @@ void on_ompt_callback_mutex_acquired(
         ompt_mutex_t kind,
         ompt_wait_id_t waitId,
         const void *codePtrRa) {
+  CallbackTimer timer(eCbMutexAcquired);
   RAW_DLOG(INFO, "on_ompt_callback_mutex_acquired called");
   incrementLabelId();
   int taskType, threadNum;
@@ -248,6 +250,7 @@ void on_ompt_callback_mutex_released(
         ompt_mutex_t kind,
         ompt_wait_id_t waitId,
         const void *codePtrRa) {
+  CallbackTimer timer(eCbMutexReleased);
   RAW_DLOG(INFO, "on_ompt_callback_mutex_released called");
   incrementLabelId();
   int taskType, threadNum;
@@ -379,6 +382,7 @@ void on_ompt_callback_work(
       ompt_data_t *taskData,
       uint64_t count,
       const void *codePtrRa) {
+  CallbackTimer timer(eCbWork);
   RAW_DLOG(INFO, "on_ompt_callback_work called");
   incrementLabelId();
   if (!taskData || !taskData->ptr) {
@@ -429,11 +433,13 @@ void on_ompt_callback_parallel_begin(
        unsigned int requestedParallelism,
        int flags,
        const void *codePtrRa) {
+  CallbackTimer timer(eCbParallelBegin);
   RAW_DLOG(INFO, "parallel begin et:%lx p:%lx %u %d", encounteringTaskData, 
            parallelData, requestedParallelism, flags);
   incrementLabelId();
   auto parRegionData = new ParRegionData(requestedParallelism, flags);
   parallelData->ptr = static_cast<void*>(parRegionData);  
+  enterParallelRegion();
 }
 
 void on_ompt_callback_parallel_end( 
@@ -441,6 +447,7 @@ void on_ompt_callback_parallel_end(
        ompt_data_t *encounteringTaskData,
        int flags,
        const void *codePtrRa) {
+  CallbackTimer timer(eCbParallelEnd);
   RAW_DLOG(INFO, "parallel end et:%lx p:%lx par data: %lx flag:%lx", 
 		  encounteringTaskData, 
 		  parallelData,
@@ -449,6 +456,7 @@ void on_ompt_callback_parallel_end(
   incrementLabelId();
   auto parRegionData = parallelData->ptr;
   delete static_cast<ParRegionData*>(parRegionData);
+  exitParallelRegion();
 }  
 
 void on_ompt_callback_task_create(
@@ -458,6 +466,7 @@ void on_ompt_callback_task_create(
         int flags,
         int hasDependences,
         const void *codePtrRa) {
+  CallbackTimer timer(eCbTaskCreate);
   auto taskData = new TaskData();
   incrementLabelId();
   if (flags == ompt_task_initial) {
@@ -480,6 +489,7 @@ void on_ompt_callback_task_create(
     auto newTaskLabel = genExpTaskLabel(parentLabel);
     taskData->label = std::move(newTaskLabel);
     taskData->isExplicitTask = true; // mark current task as explicit task
+    taskData->isSerialTask = enterSerialTask();
     auto mutatedParentLabel = mutateParentTaskCreate(parentLabel); 
     parentTaskData->label = std::move(mutatedParentLabel);
     parentTaskData->childExpTaskData.push_back(static_cast<void*>(taskData));
@@ -488,7 +498,7 @@ void on_ompt_callback_task_create(
     void* parallelDataPtr = nullptr;   
     if (!queryParallelInfo(0, teamSize, parallelDataPtr)) {
       RAW_LOG(WARNING, "cannot get parallel region data");
-    } else {
+    } else if (parallelDataPtr) { // the initial parallel region has no data
       auto parallelData = static_cast<ParRegionData*>(parallelDataPtr);
       auto taskId = parallelData->expTaskCount.fetch_add(1, 
 		      std::memory_order_relaxed);
@@ -518,6 +528,7 @@ void on_ompt_callback_task_schedule(
         ompt_data_t *priorTaskData,
         ompt_task_status_t priorTaskStatus,
         ompt_data_t *nextTaskData) {
+  CallbackTimer timer(eCbTaskSchedule);
   RAW_DLOG(INFO, "ompt_callback_task_schedule"); 
   auto taskPtr = priorTaskData->ptr;
   incrementLabelId();
@@ -530,6 +541,9 @@ void on_ompt_callback_task_schedule(
       handleTaskComplete(taskPtr);
       recycleTaskThreadStackMemory(taskPtr);
       recycleTaskPrivateMemory();
+      if (static_cast<TaskData*>(taskPtr)->isSerialTask) {
+        exitSerialTask();
+      }
       break;
     case ompt_task_yield:
       RAW_DLOG(INFO, "taskyield construct encountered");
@@ -558,6 +572,7 @@ void on_ompt_callback_dependences(
         ompt_data_t *taskData,
         const ompt_dependence_t *deps,
         int ndeps) {
+  CallbackTimer timer(eCbDependences);
   RAW_DLOG(INFO, "callback dependencies -- num deps: %lu", ndeps);
   incrementLabelId();
   auto teamSize = 0;
@@ -591,6 +606,7 @@ void on_ompt_callback_dependences(
 void on_ompt_callback_thread_begin(
        ompt_thread_t threadType,
        ompt_data_t *threadData) {
+  CallbackTimer timer(eCbThreadBegin);
   if (!threadData) {
     RAW_LOG(WARNING, "thread data is null");
     return;
@@ -613,17 +629,20 @@ void on_ompt_callback_thread_begin(
            reinterpret_cast<uint64_t>(stackAddr) +
            static_cast<uint64_t>(stackSize));             
   newThreadData->stackTopAddr = stackTopAddr;    
+  newThreadData->stackShadow = createStackShadow(stackAddr, stackTopAddr);
 }
 
 void on_ompt_callback_thread_end(
        ompt_data_t *threadData) {
+  CallbackTimer timer(eCbThreadEnd);
   if (!threadData) {
     return;
   }
   incrementLabelId();
-  auto dataPtr = threadData->ptr;
-  if (!dataPtr) {
-    delete static_cast<ThreadData*>(dataPtr);
+  auto dataPtr = static_cast<ThreadData*>(threadData->ptr);
+  if (dataPtr) {
+    destroyShadowRegion(dataPtr->stackShadow);
+    delete dataPtr;
   }
   threadData->ptr = nullptr;
 }
@@ -633,6 +652,7 @@ void on_ompt_callback_dispatch(
        ompt_data_t *taskData,
        ompt_dispatch_t kind,
        ompt_data_t instance) {
+  CallbackTimer timer(eCbDispatch);
   if (!taskData || !taskData->ptr) {
     RAW_LOG(FATAL, "cannot get task data info");
     return;
@@ -659,6 +679,7 @@ void on_ompt_callback_reduction(
        ompt_data_t *parallelData,
        ompt_data_t *taskData,
        const void *codePtrRa) {
+  CallbackTimer timer(eCbReduction);
   if (!taskData || !taskData->ptr) {
     RAW_LOG(FATAL, "task data pointer is null");
     return;
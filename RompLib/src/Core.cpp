@@ -5,6 +5,7 @@
 
 #include "ParRegionData.h"
 #include "QueryFuncs.h"
+#include "Stats.h"
 #include "ThreadData.h"
 
 namespace romp {
@@ -57,7 +58,7 @@ bool analyzeRaceCondition(const Record& histRecord, const Record& curRecord,
       void* parallelDataPtr = nullptr;
       if (!queryParallelInfo(0, teamSize, parallelDataPtr)) {
         RAW_LOG(WARNING, "cannot get parallel region data");
-      } else {
+      } else if (parallelDataPtr) { // no task graph outside parallel regions
         auto parallelData = static_cast<ParRegionData*>(parallelDataPtr); 
         // have to lock the task dep graph before graph traversal
 	McsNode node;
@@ -88,6 +89,18 @@ bool analyzeMutualExclusion(const Record& histRecord, const Record& curRecord) {
 }
 
 
+/*
+ * Return true if T(histLabel, 1) and T(curLabel, 1) are explicit tasks, 
+ * which are created by the root task outside of any parallel region.
+ */
+bool areSerialTasks(Label* histLabel, Label* curLabel) {
+  if (histLabel->getLabelLength() < 2 || curLabel->getLabelLength() < 2) {
+    return false;
+  }
+  return histLabel->getKthSegment(1)->getType() == eExplicit &&
+         curLabel->getKthSegment(1)->getType() == eExplicit;
+}
+
 /*
  * This function analyzes the happens-before relationship between two memory
  * accesses based on their associated task labels. The idea is that task label
@@ -104,6 +117,7 @@ bool analyzeMutualExclusion(const Record& histRecord, const Record& curRecord) {
  * Issue fatal warning if current task happens before hist task.
  */
 bool happensBefore(Label* histLabel, Label* curLabel, int& diffIndex) {
+  addStat(eStatHappensBefore);
   diffIndex = compareLabels(histLabel, curLabel);
   if (diffIndex < 0) {
     switch(diffIndex) {
@@ -137,9 +151,11 @@ bool happensBefore(Label* histLabel, Label* curLabel, int& diffIndex) {
       case eImplicit:
         /* 
          * T(histLabel, diffIndex) and T(curLabel, diffIndex) are both the root
-         * task, T(curLabel) should have encountered a barrier counstruct
+         * task, T(curLabel) should have encountered a barrier counstruct. 
+         * Unless both accesses are in explicit tasks the root task created 
+         * outside of parallel regions, which have no barrier.
          */
-        if (diffIndex == 0) {
+        if (diffIndex == 0 && !areSerialTasks(histLabel, curLabel)) {
           return true;
 	}
         return analyzeSameTask(histLabel, curLabel, diffIndex);
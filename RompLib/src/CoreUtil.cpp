@@ -1,16 +1,31 @@
 #include "CoreUtil.h"
+#include "MemoryBudget.h"
+#include "ShadowAccess.h"
 #include "ThreadData.h"
 
+#include <atomic>
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 #include <string>
 #include <vector>
 
-using namespace Dyninst;
-using namespace SymtabAPI;
+extern "C" {
+/*
+ * Instrumented code tests this word inline and only calls `checkAccess` when
+ * it is non-zero, so serial code pays a load and a branch per access. The 
+ * word is set while at least one parallel region or an explicit task created
+ * outside of parallel regions is active. Both only begin after ompt is 
+ * initialized.
+ */
+int gRompCheckEnabled = 0;
+}
 
 namespace romp {
 
+static std::atomic_int gNumActiveParRegions(0);
+// explicit tasks counted in `gNumActiveParRegions` by `enterSerialTask`
+static std::atomic_int gNumSerialTasks(0);
+
 /*
  * Called by `checkAccess`. This function prepares all information 
  * for data race detection algorithm. This function does best effort to 
@@ -36,53 +51,6 @@ bool prepareAllInfo(int& taskType,
   return true;
 }
 
-/*
- * Report data race with line information. The function uses symtabAPI's 
- * api to get line information. It incurs quite large overhead because of 
- * the inefficiency of parsing debug information everytime for every 
- * instruction address. 
- */
-void reportDataRaceWithLineInfo(const DataRaceInfo& info, Symtab* symtab) {
-  auto instnPrev = reinterpret_cast<uint64_t>(info.instnAddrPrev);
-  auto instnCur = reinterpret_cast<uint64_t>(info.instnAddrCur);
-  std::vector<LineNoTuple> linesPrev;
-  std::vector<LineNoTuple> linesCur;
-  std::string prevFileName;
-  auto prevLine = -1;
-  int prevColumn = -1;
-  std::string curFileName;
-  auto curLine = -1;
-  auto curColumn = -1;
-  symtab->getSourceLines(linesPrev, instnPrev);
-  if (linesPrev.empty()) {
-    RAW_LOG(WARNING, "cannot get source line info for instn addr: %lx", instnPrev);
-  } else {
-    prevFileName = linesPrev[0].getFile();
-    prevLine = linesPrev[0].getLine();
-    prevColumn = linesPrev[0].getColumn();
-  }
-  symtab->getSourceLines(linesCur, instnCur);
-  if (linesCur.empty()) {
-    RAW_LOG(WARNING, "cannot get source line info for instn addr: %lx", instnCur);
-  } else {
-    curFileName = linesCur[0].getFile();
-    curLine = linesCur[0].getLine();
-    curColumn = linesCur[0].getColumn();
-  }
-  if (!linesCur.empty() && !linesPrev.empty()) {
-    RAW_LOG(INFO, "data race found at mem addr: \
-      %lx\n %s@[%lx]line:%d col:%d vs %s@[%lx]line:%d col:%d ", info.memAddr, 
-          prevFileName.c_str(), instnPrev, prevLine, prevColumn, 
-          curFileName.c_str(), instnCur, curLine, curColumn);
-  } else if (!linesCur.empty()) {
-    RAW_LOG(INFO, "data race found at mem addr: %lx\n %s@[%lx]line:%d col:%d", 
-            info.memAddr, curFileName.c_str(), instnCur, curLine, curColumn);
-  } else {
-    RAW_LOG(INFO, "data race found at mem addr: %lx\n %s@[%lx]line:%d col:%d", 
-            info.memAddr, prevFileName.c_str(), instnPrev, prevLine, prevColumn);
-  }
-}
-
 void reportDataRace(void* instnAddrPrev, void* instnAddrCur, uint64_t memAddr) {
   RAW_LOG(INFO, "instn addr: %p vs instn addr: %p @ %p", 
           instnAddrPrev, instnAddrCur, (void*)memAddr);
@@ -105,4 +73,56 @@ void incrementLabelId() {
   threadData->labelId++;
 }
 
+/*
+ * Called upon parallel region begin. The outermost parallel region enables
+ * checking in the instrumented code. Before that, only the initial task 
+ * runs, which is the point to maintain the shadow memory and to enforce 
+ * the memory budget.
+ */
+void enterParallelRegion() {
+  if (gNumActiveParRegions.fetch_add(1) == 0) {
+    maintainShadowMemory();
+    enforceMemoryBudget();
+    __atomic_store_n(&gRompCheckEnabled, 1, __ATOMIC_RELEASE);
+  }
+}
+
+/*
+ * Called upon parallel region end. Once the outermost parallel region ends, 
+ * only the initial task runs, whose accesses are not checked, so the shadow
+ * memory is maintained and the memory budget is enforced.
+ */
+void exitParallelRegion() {
+  if (gNumActiveParRegions.fetch_sub(1) == 1) {
+    __atomic_store_n(&gRompCheckEnabled, 0, __ATOMIC_RELEASE);
+    maintainShadowMemory();
+    enforceMemoryBudget();
+  }
+}
+
+/*
+ * Called upon explicit task creation. A task created outside of any 
+ * parallel region still has to be checked, so it enables checking like a
+ * parallel region until it completes. Only the initial task runs there, so
+ * the test and the increment cannot interleave with another creation.
+ * Return true if the task entered such a scope.
+ */
+bool enterSerialTask() {
+  if (gNumActiveParRegions.load() > gNumSerialTasks.load()) {
+    return false;
+  }
+  gNumSerialTasks.fetch_add(1);
+  enterParallelRegion();
+  return true;
+}
+
+/*
+ * Called upon completion of a task for which `enterSerialTask` returned 
+ * true.
+ */
+void exitSerialTask() {
+  gNumSerialTasks.fetch_sub(1);
+  exitParallelRegion();
+}
+
 }
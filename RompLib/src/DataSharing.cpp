@@ -7,7 +7,7 @@
 #include "AccessHistory.h"
 #include "CoreUtil.h"
 #include "QueryFuncs.h"
-#include "ShadowMemory.h"
+#include "ShadowAccess.h"
 #include "TaskData.h"
 #include "ThreadData.h"
 
@@ -71,16 +71,8 @@ void recycleMemRange(void* lowerBound, void* upperBound) {
             upperBound, lowerBound);
     return;
   }
-  auto start = reinterpret_cast<uint64_t>(lowerBound);
-  auto end = reinterpret_cast<uint64_t>(upperBound);
-  ShadowMemory<AccessHistory> shadowMemory;
-  for (auto addr = start; addr <= end; addr++) {
-    auto accessHistory = shadowMemory.getShadowMemorySlot(addr);
-    //std::unique_lock<std::mutex> guard(accessHistory->getMutex());
-    McsNode node;
-    LockGuard guard(&(accessHistory->getLock()), &node);
-    accessHistory->setFlag(eMemoryRecycled);
-  }
+  recycleShadowRange(reinterpret_cast<uint64_t>(lowerBound), 
+                     reinterpret_cast<uint64_t>(upperBound));
 }
 
 /*
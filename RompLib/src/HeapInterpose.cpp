@@ -0,0 +1,120 @@
+#include "HeapInterpose.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <glog/logging.h>
+#include <malloc.h>
+
+#include "ShadowAccess.h"
+#include "Stats.h"
+
+/*
+ * glibc's own entry points, calling them never re-enters the definitions 
+ * below.
+ */
+extern "C" {
+void* __libc_malloc(size_t size);
+void __libc_free(void* ptr);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace romp {
+
+static bool gReclaimHeap = false;
+
+/*
+ * Set while a thread releases shadow memory. Freeing record storage and 
+ * shadow pages on the way calls free again, those calls are only forwarded.
+ * The tls model avoids a lazy tls allocation, which would call malloc.
+ */
+static thread_local bool tInHeapHook 
+        __attribute__((tls_model("initial-exec"))) = false;
+
+void enableHeapReclamation() {
+  gReclaimHeap = true;
+  LOG(INFO) << "shadow memory of freed heap blocks is released";
+}
+
+/*
+ * Release the access histories of the `size` bytes at `ptr`. Called before 
+ * the block goes back to glibc, so no other allocation owns it yet.
+ */
+static void releaseHeapBlock(void* ptr, size_t size) {
+  if (!gReclaimHeap || ptr == nullptr || size == 0 || tInHeapHook) {
+    return;
+  }
+  tInHeapHook = true;
+  auto start = reinterpret_cast<uint64_t>(ptr);
+  releaseShadowRange(start, start + size - 1);
+  addStat(eStatHeapReclaims);
+  tInHeapHook = false;
+}
+
+}
+
+using namespace romp;
+
+extern "C" {
+
+void* malloc(size_t size) {
+  return __libc_malloc(size);
+}
+
+void free(void* ptr) {
+  if (gReclaimHeap && ptr != nullptr) {
+    releaseHeapBlock(ptr, malloc_usable_size(ptr));
+  }
+  __libc_free(ptr);
+}
+
+/*
+ * Like free, memory is released before glibc can hand it to another 
+ * thread. Once glibc returns, an old block or tail may already be owned 
+ * and accessed by another allocation. A growing block is therefore moved 
+ * here, and a shrinking block releases its tail first; glibc shrinks a 
+ * block in place.
+ */
+void* realloc(void* ptr, size_t size) {
+  if (!gReclaimHeap || ptr == nullptr) {
+    return __libc_realloc(ptr, size);
+  }
+  if (size == 0) {
+    free(ptr);
+    return nullptr;
+  }
+  auto oldSize = malloc_usable_size(ptr);
+  if (size <= oldSize) {
+    releaseHeapBlock(static_cast<char*>(ptr) + size, oldSize - size);
+    auto result = __libc_realloc(ptr, size);
+    if (result != nullptr && result != ptr) {
+      // not expected, the old block went back to glibc before its release
+      releaseHeapBlock(ptr, size);
+    }
+    return result;
+  }
+  auto result = __libc_malloc(size);
+  if (result == nullptr) {
+    return nullptr;
+  }
+  memcpy(result, ptr, oldSize);
+  releaseHeapBlock(ptr, oldSize);
+  __libc_free(ptr);
+  return result;
+}
+
+int posix_memalign(void** memPtr, size_t alignment, size_t size) {
+  if (alignment % sizeof(void*) != 0 || 
+          (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  auto result = __libc_memalign(alignment, size);
+  if (result == nullptr) {
+    return ENOMEM;
+  }
+  *memPtr = result;
+  return 0;
+}
+
+}
@@ -0,0 +1,124 @@
+#include "HugePages.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <glog/raw_logging.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+
+#include "Stats.h"
+
+namespace romp {
+
+bool parseHugePageMode(const char* name, HugePageMode& mode) {
+  auto value = std::string(name);
+  if (value == "off") {
+    mode = eHugePagesOff;
+  } else if (value == "on" || value == "thp") {
+    mode = eTransparentHugePages;
+  } else if (value == "hugetlb") {
+    mode = eHugetlbPages;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Map an anonymous chunk of at least `bytes` bytes for shadow pages and
+ * store its final length in `bytes`. With huge pages, the chunk is a
+ * multiple of 2 MB and aligned to 2 MB, so every 2 MB of it can be backed
+ * by a huge page. A mode that is not available is downgraded in `mode`, so
+ * later chunks do not try it again. Return nullptr if nothing can be
+ * mapped.
+ */
+void* mapShadowChunk(uint64_t& bytes, HugePageMode& mode) {
+  const auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  const auto protection = PROT_READ | PROT_WRITE;
+  if (mode == eHugePagesOff) {
+    auto chunk = mmap(nullptr, bytes, protection, flags, -1, 0);
+    return chunk == MAP_FAILED ? nullptr : chunk;
+  }
+  bytes = (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+  if (mode == eHugetlbPages) {
+    // reserve the huge pages now, a fault on an empty pool raises SIGBUS
+    auto chunk = mmap(nullptr, bytes, protection, 
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (chunk != MAP_FAILED) {
+      addStat(eStatShadowHugetlbChunks);
+      return chunk;
+    }
+    RAW_LOG(WARNING, "no huge tlb pages for shadow memory: %s, using "
+            "transparent huge pages", strerror(errno));
+    mode = eTransparentHugePages;
+  }
+  // over map by one huge page, then trim the unaligned head and tail
+  auto mapBytes = bytes + HUGE_PAGE_BYTES;
+  auto mapping = mmap(nullptr, mapBytes, protection, flags, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+  auto mapStart = reinterpret_cast<uint64_t>(mapping);
+  auto chunkStart = (mapStart + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1);
+  if (chunkStart > mapStart) {
+    munmap(mapping, chunkStart - mapStart);
+  }
+  auto tailBytes = mapStart + mapBytes - (chunkStart + bytes);
+  if (tailBytes > 0) {
+    munmap(reinterpret_cast<void*>(chunkStart + bytes), tailBytes);
+  }
+  auto chunk = reinterpret_cast<void*>(chunkStart);
+  if (madvise(chunk, bytes, MADV_HUGEPAGE) != 0) {
+    RAW_LOG(WARNING, "transparent huge pages are not available: %s",
+            strerror(errno));
+    mode = eHugePagesOff;
+  }
+  return chunk;
+}
+
+/*
+ * Sum the huge page backed bytes of the mappings overlapping `chunks`, as
+ * reported in /proc/self/smaps. The kernel may merge neighbouring chunks
+ * into one mapping, which is counted once.
+ */
+uint64_t countHugeBackedBytes(
+        const std::vector<std::pair<void*, uint64_t>>& chunks) {
+  std::ifstream smaps("/proc/self/smaps");
+  if (!smaps.is_open()) {
+    return 0;
+  }
+  uint64_t hugeKBytes = 0;
+  auto overlaps = false;
+  std::string line;
+  while (std::getline(smaps, line)) {
+    uint64_t start = 0, end = 0;
+    char dash = 0;
+    std::istringstream header(line);
+    if (header >> std::hex >> start >> dash >> end && dash == '-') {
+      overlaps = false;
+      for (const auto& chunk : chunks) {
+        auto chunkStart = reinterpret_cast<uint64_t>(chunk.first);
+        if (chunkStart < end && chunkStart + chunk.second > start) {
+          overlaps = true;
+          break;
+        }
+      }
+      continue;
+    }
+    if (!overlaps) {
+      continue;
+    }
+    std::istringstream field(line);
+    std::string name;
+    uint64_t kBytes = 0;
+    if (field >> name >> kBytes && (name == "AnonHugePages:" ||
+            name == "Private_Hugetlb:" || name == "Shared_Hugetlb:")) {
+      hugeKBytes += kBytes;
+    }
+  }
+  return hugeKBytes << 10;
+}
+
+}
@@ -0,0 +1,166 @@
+#include "InstnProfile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "McsLock.h"
+#include "Symbolizer.h"
+
+namespace romp {
+
+/*
+ * Each thread updates its own counters table without synchronization. 
+ * Tables are registered once per thread and merged when the profile is 
+ * dumped at the end of the execution.
+ */
+static McsLock gInstnTablesLock;
+static std::vector<InstnCountersTable*> gInstnTables;
+static thread_local InstnCountersTable* tInstnTable = nullptr;
+
+static InstnCountersTable* getThreadInstnTable() {
+  if (!tInstnTable) {
+    tInstnTable = new InstnCountersTable();
+    McsNode node;
+    LockGuard guard(&gInstnTablesLock, &node);
+    gInstnTables.push_back(tInstnTable);
+  }
+  return tInstnTable;
+}
+
+/*
+ * Get the counters of the instruction at `instnAddr` in the current thread's 
+ * table. The returned reference stays valid when the table grows.
+ */
+InstnCounters& getInstnCounters(void* instnAddr) {
+  return (*getThreadInstnTable())[reinterpret_cast<uint64_t>(instnAddr)];
+}
+
+/*
+ * Called for every history record the current access is checked against.
+ * If the two accesses come from different tasks and one of them is a write,
+ * the data is not read-only and both instructions are marked as conflicting.
+ * `curCounters` are the counters of the current access's instruction.
+ */
+void profileAccessPair(const Record& histRecord, const Record& curRecord, 
+                       InstnCounters* curCounters, bool isRace) {
+  if (histRecord.getTaskPtr() == curRecord.getTaskPtr() ||
+      (!histRecord.isWrite() && !curRecord.isWrite())) {
+    return;
+  }
+  auto& histCounters = getInstnCounters(histRecord.getInstnAddr());
+  histCounters.numConflicts++;
+  curCounters->numConflicts++;
+  if (isRace) {
+    histCounters.numRaces++;
+    curCounters->numRaces++;
+  }
+}
+
+static void mergeInstnTables(InstnCountersTable& merged) {
+  McsNode node;
+  LockGuard guard(&gInstnTablesLock, &node);
+  for (const auto table : gInstnTables) {
+    for (const auto& entry : *table) {
+      auto& counters = merged[entry.first];
+      counters.numChecks += entry.second.numChecks;
+      counters.numSerial += entry.second.numSerial;
+      counters.numThreadPrivate += entry.second.numThreadPrivate;
+      counters.numShared += entry.second.numShared;
+      counters.numConflicts += entry.second.numConflicts;
+      counters.numRaces += entry.second.numRaces;
+      counters.bytesChecked += entry.second.bytesChecked;
+      counters.numHistoryChecks += entry.second.numHistoryChecks;
+      counters.historyLenSum += entry.second.historyLenSum;
+      counters.isWrite |= entry.second.isWrite;
+    }
+  }
+}
+
+/*
+ * Merge counters of all threads and write the profile to `profilePath`. 
+ * Each line holds: instruction address (hex), checks, serial, thread 
+ * private, shared, conflicts, races, is write, bytes checked, history 
+ * checks, history length sum.
+ */
+bool dumpInstnProfile(const std::string& profilePath) {
+  InstnCountersTable merged;
+  mergeInstnTables(merged);
+  std::ofstream output(profilePath, std::ios::trunc);
+  if (!output.is_open()) {
+    LOG(ERROR) << "cannot write instruction profile: " << profilePath;
+    return false;
+  }
+  output << "# romp instruction profile\n";
+  output << "# instn checks serial private shared conflicts races write "
+         << "bytes historyChecks historyLenSum\n";
+  for (const auto& entry : merged) {
+    const auto& counters = entry.second;
+    output << std::hex << entry.first << std::dec << " " 
+           << counters.numChecks << " " << counters.numSerial << " " 
+           << counters.numThreadPrivate << " " << counters.numShared << " " 
+           << counters.numConflicts << " " << counters.numRaces << " " 
+           << counters.isWrite << " " << counters.bytesChecked << " "
+           << counters.numHistoryChecks << " " << counters.historyLenSum 
+           << "\n";
+  }
+  LOG(INFO) << "instruction profile of " << merged.size() 
+            << " instructions written to " << profilePath;
+  return true;
+}
+
+/*
+ * Log the `topN` instructions with most checkAccess calls, with their 
+ * source lines when line info is available.
+ */
+void reportHotInstns(size_t topN) {
+  InstnCountersTable merged;
+  mergeInstnTables(merged);
+  std::vector<std::pair<uint64_t, InstnCounters>> hotInstns(merged.begin(),
+                                                            merged.end());
+  topN = std::min(topN, hotInstns.size());
+  std::partial_sort(hotInstns.begin(), hotInstns.begin() + topN, 
+          hotInstns.end(), 
+          [](const std::pair<uint64_t, InstnCounters>& a, 
+             const std::pair<uint64_t, InstnCounters>& b) {
+            return a.second.numChecks > b.second.numChecks;
+          });
+  hotInstns.resize(topN);
+  std::vector<uint64_t> instnAddrs;
+  for (const auto& entry : hotInstns) {
+    instnAddrs.push_back(entry.first);
+  }
+  std::vector<SourceLocation> locations;
+  auto& symbolizer = getSymbolizer();
+  if (symbolizer.open()) {
+    symbolizer.resolve(instnAddrs, locations);
+  } else {
+    locations.assign(instnAddrs.size(), SourceLocation());
+  }
+  std::stringstream report;
+  report << "top " << topN << " of " << merged.size() 
+         << " instructions by checks\n"
+         << "  instn checks bytes avgHistoryLen location\n";
+  for (size_t i = 0; i < hotInstns.size(); ++i) {
+    const auto& counters = hotInstns[i].second;
+    auto avgHistoryLen = counters.numHistoryChecks == 0 ? 0.0 : 
+        static_cast<double>(counters.historyLenSum) / 
+        counters.numHistoryChecks;
+    report << "  " << std::hex << hotInstns[i].first << std::dec << " " 
+           << counters.numChecks << " " << counters.bytesChecked << " " 
+           << std::fixed << std::setprecision(2) << avgHistoryLen << " ";
+    if (locations[i].file) {
+      report << *(locations[i].file) << ":" << locations[i].line;
+    } else {
+      report << "?";
+    }
+    report << "\n";
+  }
+  LOG(INFO) << report.str();
+}
+
+}
@@ -3,6 +3,8 @@
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+#include "MemoryBudget.h"
+
 namespace romp {
 
 /* 
@@ -13,6 +15,18 @@ namespace romp {
  */
 Label::Label(const Label& label) {
   _label = label._label; 
+  chargeMemory(eMemLabels, sizeof(Label) + 
+          _label.capacity() * sizeof(std::shared_ptr<Segment>));
+}
+
+Label::Label() {
+  chargeMemory(eMemLabels, sizeof(Label));
+}
+
+Label::~Label() {
+  auto bytes = sizeof(Label) + 
+          _label.capacity() * sizeof(std::shared_ptr<Segment>);
+  chargeMemory(eMemLabels, -static_cast<int64_t>(bytes));
 }
 
 std::string Label::toString() const {
@@ -25,7 +39,12 @@ std::string Label::toString() const {
 }
 
 void Label::appendSegment(const std::shared_ptr<Segment>& segment) {
+  auto capacity = _label.capacity();
   _label.push_back(segment);
+  if (_label.capacity() != capacity) {
+    chargeMemory(eMemLabels, 
+            (_label.capacity() - capacity) * sizeof(std::shared_ptr<Segment>));
+  }
 }
 
 std::shared_ptr<Segment> Label::popSegment() {
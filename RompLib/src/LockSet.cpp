@@ -4,6 +4,8 @@
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+#include "MemoryBudget.h"
+
 namespace romp {
 
 SmallLockSet::SmallLockSet() {
@@ -11,6 +13,7 @@ SmallLockSet::SmallLockSet() {
     _locks[i] = 0;
   }
   _numLocks = 0;
+  chargeMemory(eMemLockSets, sizeof(SmallLockSet));
 }
 
 SmallLockSet::SmallLockSet(const SmallLockSet& lockset) {
@@ -18,6 +21,11 @@ SmallLockSet::SmallLockSet(const SmallLockSet& lockset) {
     _locks[i] = lockset._locks[i];
   }
   _numLocks = lockset._numLocks;
+  chargeMemory(eMemLockSets, sizeof(SmallLockSet));
+}
+
+SmallLockSet::~SmallLockSet() {
+  chargeMemory(eMemLockSets, -static_cast<int64_t>(sizeof(SmallLockSet)));
 }
 
 std::string SmallLockSet::toString() const {
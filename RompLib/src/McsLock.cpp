@@ -64,6 +64,7 @@
 //******************************************************************************
 
 #include "McsLock.h"
+#include "Stats.h"
 
 //******************************************************************************
 // private operations
@@ -114,8 +115,14 @@ mcsLock(McsLock *l, McsNode *me)
     //       critical section will not occur until after blocked is
     //       cleared
     //------------------------------------------------------------------
-    while (std::atomic_load_explicit(&me->blocked, std::memory_order_acquire));
+    uint64_t numSpins = 0;
+    while (std::atomic_load_explicit(&me->blocked, std::memory_order_acquire)) {
+      numSpins++;
+    }
+    romp::addStat(romp::eStatMcsContended);
+    romp::addStat(romp::eStatMcsSpins, numSpins);
   }
+  romp::addStat(romp::eStatMcsAcquire);
 }
 
 
@@ -0,0 +1,144 @@
+#include "MemoryBudget.h"
+
+#include <cstdlib>
+#include <glog/logging.h>
+#include <string>
+
+#include "ShadowAccess.h"
+
+namespace romp {
+
+bool gMemoryBudgetEnabled = false;
+std::atomic<bool> gOverMemoryBudget(false);
+
+static uint64_t gMemoryBudget = 0;
+static std::atomic<int64_t> gMemoryUsage[eNumMemoryKinds];
+static std::atomic<int64_t> gTotalMemoryUsage(0);
+static std::atomic<int64_t> gPeakMemoryUsage(0);
+static std::atomic<uint64_t> gBudgetEvents[eNumBudgetEvents];
+
+static const char* kMemoryKindNames[eNumMemoryKinds] = {
+  "shadow pages",
+  "records",
+  "labels",
+  "lock sets",
+};
+
+static const char* kBudgetEventNames[eNumBudgetEvents] = {
+  "shadow pages evicted",
+  "histories truncated",
+  "records truncated",
+  "accesses skipped",
+  "records dropped",
+};
+
+/*
+ * Called once from omptInitialize, before the shadow memory is created. 
+ * A budget of 0 disables accounting.
+ */
+void configureMemoryBudget(uint64_t budgetBytes) {
+  gMemoryBudget = budgetBytes;
+  gMemoryBudgetEnabled = budgetBytes > 0;
+  if (gMemoryBudgetEnabled) {
+    LOG(INFO) << "memory budget: " << budgetBytes << " bytes";
+  }
+}
+
+/*
+ * Parse a byte count with an optional K, M or G suffix.
+ */
+bool parseMemorySize(const char* value, uint64_t& bytes) {
+  char* end = nullptr;
+  auto size = strtoull(value, &end, 10);
+  if (end == value) {
+    return false;
+  }
+  auto suffix = std::string(end);
+  if (suffix == "K" || suffix == "k") {
+    size <<= 10;
+  } else if (suffix == "M" || suffix == "m") {
+    size <<= 20;
+  } else if (suffix == "G" || suffix == "g") {
+    size <<= 30;
+  } else if (!suffix.empty()) {
+    return false;
+  }
+  bytes = size;
+  return true;
+}
+
+void updateMemoryUsage(MemoryKind kind, int64_t bytes) {
+  gMemoryUsage[kind].fetch_add(bytes, std::memory_order_relaxed);
+  auto total = gTotalMemoryUsage.fetch_add(bytes, 
+          std::memory_order_relaxed) + bytes;
+  if (bytes <= 0) {
+    return;
+  }
+  auto peak = gPeakMemoryUsage.load(std::memory_order_relaxed);
+  while (total > peak && !gPeakMemoryUsage.compare_exchange_weak(peak, 
+              total, std::memory_order_relaxed)) {}
+  if (static_cast<uint64_t>(total) > gMemoryBudget && 
+          !gOverMemoryBudget.load(std::memory_order_relaxed)) {
+    gOverMemoryBudget.store(true, std::memory_order_relaxed);
+  }
+}
+
+void countBudgetEvent(BudgetEvent event, uint64_t count) {
+  gBudgetEvents[event].fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t getMemoryUsage() {
+  auto total = gTotalMemoryUsage.load(std::memory_order_relaxed);
+  return total > 0 ? static_cast<uint64_t>(total) : 0;
+}
+
+/*
+ * Called while no parallel region is active, so no access is being checked
+ * and shadow pages can be freed. Evict cold shadow pages first, truncate 
+ * access histories only if that does not bring usage below the target.
+ */
+void enforceMemoryBudget() {
+  if (!gMemoryBudgetEnabled) {
+    return;
+  }
+  auto usage = getMemoryUsage();
+  if (usage * 100 > gMemoryBudget * BUDGET_EVICT_PERCENT) {
+    auto target = gMemoryBudget * BUDGET_TARGET_PERCENT / 100;
+    evictColdShadowPages(usage - target);
+    if (getMemoryUsage() > target) {
+      truncateAccessHistories(TRUNCATED_HISTORY_LEN);
+    }
+  }
+  gOverMemoryBudget.store(getMemoryUsage() > gMemoryBudget, 
+          std::memory_order_relaxed);
+}
+
+/*
+ * Log the peak usage per kind and warn about every eviction, since each of
+ * them may have hidden a data race.
+ */
+void reportMemoryBudget() {
+  if (!gMemoryBudgetEnabled) {
+    return;
+  }
+  LOG(INFO) << "memory budget: " << gMemoryBudget << " bytes, peak usage: " 
+            << gPeakMemoryUsage.load() << " bytes";
+  for (int i = 0; i < eNumMemoryKinds; ++i) {
+    LOG(INFO) << "  " << kMemoryKindNames[i] << ": " 
+              << gMemoryUsage[i].load() << " bytes at exit";
+  }
+  uint64_t numEvents = 0;
+  for (int i = 0; i < eNumBudgetEvents; ++i) {
+    numEvents += gBudgetEvents[i].load();
+  }
+  if (numEvents == 0) {
+    return;
+  }
+  LOG(WARNING) << "memory budget exceeded, data races may have been missed";
+  for (int i = 0; i < eNumBudgetEvents; ++i) {
+    LOG(WARNING) << "  " << kBudgetEventNames[i] << ": " 
+                 << gBudgetEvents[i].load();
+  }
+}
+
+}
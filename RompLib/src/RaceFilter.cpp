@@ -0,0 +1,296 @@
+#include "RaceFilter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <glog/logging.h>
+#include <utility>
+#include <vector>
+
+#include "Symbolizer.h"
+
+#define RACY_INSTN_CAPACITY_BITS 16
+#define RACE_PAIR_CAPACITY_BITS 16
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15
+
+namespace romp {
+
+static inline uint64_t hashKey(uint64_t key, uint32_t capacityBits) {
+  return (key * HASH_MULTIPLIER) >> (64 - capacityBits);
+}
+
+ConcurrentAddrSet::ConcurrentAddrSet(uint32_t capacityBits):
+    capacityBits_(capacityBits),
+    mask_((1ULL << capacityBits) - 1),
+    slots_(new std::atomic<uint64_t>[1ULL << capacityBits]) {
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    slots_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Insert `key` with linear probing. Return true if the key is newly
+ * inserted, false if it is present already or the set is full.
+ */
+bool ConcurrentAddrSet::insert(uint64_t key) {
+  auto index = hashKey(key, capacityBits_);
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    auto& slot = slots_[(index + i) & mask_];
+    auto cur = slot.load(std::memory_order_acquire);
+    if (cur == key) {
+      return false;
+    }
+    if (cur == 0) {
+      uint64_t expected = 0;
+      if (slot.compare_exchange_strong(expected, key,
+                  std::memory_order_acq_rel)) {
+        return true;
+      }
+      if (expected == key) {
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+bool ConcurrentAddrSet::contains(uint64_t key) const {
+  auto index = hashKey(key, capacityBits_);
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    auto cur = slots_[(index + i) & mask_].load(std::memory_order_acquire);
+    if (cur == key) {
+      return true;
+    }
+    if (cur == 0) {
+      return false;
+    }
+  }
+  return false;
+}
+
+RacePairCounter::RacePairCounter(uint32_t capacityBits):
+    capacityBits_(capacityBits),
+    mask_((1ULL << capacityBits) - 1),
+    slots_(new Slot[1ULL << capacityBits]) {}
+
+/*
+ * Increment the counter of the pair and return the new count. If the table
+ * is full, 1 is returned so that the pair is still treated as new.
+ */
+uint64_t RacePairCounter::increment(uint64_t instnPrev, uint64_t instnCur) {
+  auto index = hashKey(instnPrev * HASH_MULTIPLIER ^ instnCur, capacityBits_);
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    auto& slot = slots_[(index + i) & mask_];
+    auto prev = slot.instnPrev.load(std::memory_order_acquire);
+    if (prev == 0) {
+      uint64_t expected = 0;
+      if (slot.instnPrev.compare_exchange_strong(expected, instnPrev,
+                  std::memory_order_acq_rel)) {
+        slot.instnCur.store(instnCur, std::memory_order_release);
+        return slot.count.fetch_add(1, std::memory_order_relaxed) + 1;
+      }
+      prev = expected;
+    }
+    if (prev != instnPrev) {
+      continue;
+    }
+    uint64_t cur;
+    // the claiming thread publishes the current instruction right away
+    while ((cur = slot.instnCur.load(std::memory_order_acquire)) == 0) {}
+    if (cur == instnCur) {
+      return slot.count.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+  }
+  return 1;
+}
+
+static bool gSkipRacyInstn = false;
+static uint64_t gMaxReportsPerPair = 0;
+static ConcurrentAddrSet* gRacyInstns = nullptr;
+static RacePairCounter* gRacePairCounter = nullptr;
+
+/*
+ * Called once from omptInitialize before any access is checked.
+ * `maxReportsPerPair` of 0 means no limit.
+ */
+void configureRaceFilter(bool skipRacyInstn, uint64_t maxReportsPerPair) {
+  gSkipRacyInstn = skipRacyInstn;
+  gMaxReportsPerPair = maxReportsPerPair;
+  if (skipRacyInstn) {
+    gRacyInstns = new ConcurrentAddrSet(RACY_INSTN_CAPACITY_BITS);
+    LOG(INFO) << "instructions are not checked after their first race";
+  }
+  if (maxReportsPerPair > 0) {
+    gRacePairCounter = new RacePairCounter(RACE_PAIR_CAPACITY_BITS);
+    LOG(INFO) << "at most " << maxReportsPerPair
+              << " races are reported per instruction pair";
+  }
+}
+
+void markRacyInstns(void* instnAddrPrev, void* instnAddrCur) {
+  if (!gSkipRacyInstn) {
+    return;
+  }
+  gRacyInstns->insert(reinterpret_cast<uint64_t>(instnAddrPrev));
+  gRacyInstns->insert(reinterpret_cast<uint64_t>(instnAddrCur));
+}
+
+/*
+ * Return true if the instruction was involved in a race already and
+ * checking racy instructions is turned off. Accesses of such instructions
+ * no longer enter the access history, so races between them and other
+ * instructions may be missed.
+ */
+bool isRacyInstn(void* instnAddr) {
+  return gSkipRacyInstn &&
+         gRacyInstns->contains(reinterpret_cast<uint64_t>(instnAddr));
+}
+
+bool shouldReportRacePair(void* instnAddrPrev, void* instnAddrCur) {
+  if (gMaxReportsPerPair == 0) {
+    return true;
+  }
+  auto count = gRacePairCounter->increment(
+          reinterpret_cast<uint64_t>(instnAddrPrev),
+          reinterpret_cast<uint64_t>(instnAddrCur));
+  return count <= gMaxReportsPerPair;
+}
+
+typedef std::pair<uint64_t, uint64_t> AddrRange;
+
+static bool gHasSuppressions = false;
+// sorted, disjoint [start, end) ranges of suppressed instructions
+static std::vector<AddrRange> gSuppressedRanges;
+
+/*
+ * Parse `first[-last]` into a line range.
+ */
+static bool parseLineRange(const std::string& spec, int& firstLine, 
+                           int& lastLine) {
+  char* end = nullptr;
+  firstLine = strtol(spec.c_str(), &end, 10);
+  if (end == spec.c_str()) {
+    return false;
+  }
+  lastLine = firstLine;
+  if (*end == '-') {
+    auto lastBegin = end + 1;
+    lastLine = strtol(lastBegin, &end, 10);
+    if (end == lastBegin) {
+      return false;
+    }
+  }
+  return *end == '\0' && firstLine <= lastLine;
+}
+
+/*
+ * Resolve one suppression entry into address ranges. Supported entries:
+ *   instn:<addr>[-<addr>]       instruction address or address range
+ *   func:<name>                 mangled or pretty function name
+ *   line:<file>:<line>[-<line>] source lines, file matched by path suffix
+ */
+static bool resolveSuppression(const std::string& entry,
+                               std::vector<AddrRange>& ranges) {
+  auto colon = entry.find(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+  auto kind = entry.substr(0, colon);
+  auto spec = entry.substr(colon + 1);
+  if (kind == "instn") {
+    char* end = nullptr;
+    auto start = strtoull(spec.c_str(), &end, 16);
+    auto last = start;
+    if (*end == '-') {
+      last = strtoull(end + 1, &end, 16);
+    }
+    if (*end != '\0' || last < start) {
+      return false;
+    }
+    ranges.emplace_back(start, last + 1);
+    return true;
+  }
+  auto& symbolizer = getSymbolizer();
+  if (!symbolizer.open()) {
+    return false;
+  }
+  if (kind == "func") {
+    return symbolizer.findFunctionRanges(spec, ranges);
+  }
+  if (kind == "line") {
+    auto lineColon = spec.rfind(':');
+    int firstLine, lastLine;
+    if (lineColon == std::string::npos || 
+        !parseLineRange(spec.substr(lineColon + 1), firstLine, lastLine)) {
+      return false;
+    }
+    return symbolizer.findLineRanges(spec.substr(0, lineColon), firstLine, 
+                                     lastLine, ranges);
+  }
+  return false;
+}
+
+/*
+ * Read the suppression file, one entry per line, `#` starts a comment. 
+ * Entries are merged into sorted disjoint address ranges. Entries that 
+ * cannot be resolved are reported and ignored.
+ */
+bool loadSuppressions(const std::string& suppressionPath) {
+  std::ifstream input(suppressionPath);
+  if (!input.is_open()) {
+    LOG(WARNING) << "cannot open suppression file: " << suppressionPath;
+    return false;
+  }
+  std::vector<AddrRange> ranges;
+  std::string line;
+  auto lineNum = 0;
+  while (std::getline(input, line)) {
+    lineNum++;
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line.erase(comment);
+    }
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty()) {
+      continue;
+    }
+    if (!resolveSuppression(line, ranges)) {
+      LOG(WARNING) << suppressionPath << ":" << lineNum 
+                   << ": cannot resolve suppression `" << line << "`";
+    }
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for (const auto& range : ranges) {
+    if (!gSuppressedRanges.empty() && 
+        range.first <= gSuppressedRanges.back().second) {
+      gSuppressedRanges.back().second = std::max(
+              gSuppressedRanges.back().second, range.second);
+    } else {
+      gSuppressedRanges.push_back(range);
+    }
+  }
+  gHasSuppressions = !gSuppressedRanges.empty();
+  LOG(INFO) << "loaded " << gSuppressedRanges.size() 
+            << " suppressed address ranges from " << suppressionPath;
+  return true;
+}
+
+/*
+ * Called on every `checkAccess` before any other work, so it has to be 
+ * cheap: a flag test without suppressions, a binary search otherwise.
+ */
+bool isSuppressedInstn(void* instnAddr) {
+  if (!gHasSuppressions) {
+    return false;
+  }
+  auto addr = reinterpret_cast<uint64_t>(instnAddr);
+  auto it = std::upper_bound(gSuppressedRanges.begin(), 
+          gSuppressedRanges.end(), addr, 
+          [](uint64_t addr, const AddrRange& range) {
+            return addr < range.first;
+          });
+  return it != gSuppressedRanges.begin() && addr < (it - 1)->second;
+}
+
+}
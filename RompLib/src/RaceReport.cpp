@@ -0,0 +1,534 @@
+#include "RaceReport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+#include <limits.h>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "McsLock.h"
+#include "RaceFilter.h"
+#include "Symbolizer.h"
+
+#define RACE_QUEUE_CAPACITY 4096 // must be a power of two
+#define RACE_BUFFER_CAPACITY 1024 // must be a power of two
+#define QUEUED_PAIR_CAPACITY_BITS 16
+#define REPORTER_POLL_INTERVAL_MS 10
+
+namespace romp {
+
+typedef std::pair<void*, void*> RacePairKey;
+
+typedef struct RacePairKeyHash {
+  size_t operator()(const RacePairKey& key) const {
+    auto prev = reinterpret_cast<uint64_t>(key.first);
+    auto cur = reinterpret_cast<uint64_t>(key.second);
+    return std::hash<uint64_t>()(prev * 0x9e3779b97f4a7c15 ^ cur);
+  }
+} RacePairKeyHash;
+
+/*
+ * Single producer single consumer ring of races found by one thread. The
+ * owner thread is the producer, the reporter thread the consumer. Only the
+ * first race of a pair enters the ring, the owner folds later races of the
+ * pair, and races found while the ring is full, into `pairs`, an open 
+ * addressing table merged once the reporter stopped. Queues are never 
+ * freed, so races of exited threads are still drained.
+ */
+typedef struct RaceQueue {
+  RaceQueue(): head(0), tail(0), publishing(false), numRaces(0), 
+               numLimited(0), numDropped(0), numBuffered(0) {}
+  alignas(64) std::atomic<uint64_t> head; // next slot read by the reporter
+  alignas(64) std::atomic<uint64_t> tail; // next slot written by the owner
+  std::atomic_bool publishing; // the owner is writing a slot
+  std::atomic<uint64_t> numRaces; // races found by the owner thread
+  std::atomic<uint64_t> numLimited; // races over the per pair report limit
+  std::atomic<uint64_t> numDropped; // races the reporter never received
+  uint64_t numBuffered; // pairs in `pairs`
+  DataRaceInfo slots[RACE_QUEUE_CAPACITY];
+  RacePair pairs[RACE_BUFFER_CAPACITY];
+} RaceQueue;
+
+static McsLock gRaceQueuesLock;
+static std::vector<RaceQueue*> gRaceQueues;
+static thread_local RaceQueue* tRaceQueue = nullptr;
+
+// only accessed by the reporter thread, or after it is joined
+static std::unordered_map<RacePairKey, RacePair, RacePairKeyHash> gRacePairs;
+// pairs published to a queue, racing threads agree on which one queues it
+static RacePairCounter* gQueuedPairs = nullptr;
+
+static std::thread gReporterThread;
+static std::mutex gReporterMutex;
+static std::condition_variable gReporterCond;
+static std::atomic_bool gReporterRunning(false);
+static std::atomic_bool gReporterStop(false);
+static bool gRecordRaces = false;
+static bool gReportAtRuntime = false;
+static bool gReportLineInfo = false;
+
+static RaceQueue* getThreadRaceQueue() {
+  if (!tRaceQueue) {
+    tRaceQueue = new RaceQueue();
+    McsNode node;
+    LockGuard guard(&gRaceQueuesLock, &node);
+    gRaceQueues.push_back(tRaceQueue);
+  }
+  return tRaceQueue;
+}
+
+static void wakeReporter() {
+  std::lock_guard<std::mutex> guard(gReporterMutex);
+  gReporterCond.notify_one();
+}
+
+static void reportNewRacePair(const RacePair& racePair) {
+  auto& symbolizer = getSymbolizer();
+  if (!gReportLineInfo || !symbolizer.open()) {
+    reportDataRace(racePair.instnAddrPrev, racePair.instnAddrCur,
+                   racePair.minAddr);
+    return;
+  }
+  SourceLocation prevLocation, curLocation;
+  symbolizer.lookup(reinterpret_cast<uint64_t>(racePair.instnAddrPrev),
+                    prevLocation);
+  symbolizer.lookup(reinterpret_cast<uint64_t>(racePair.instnAddrCur),
+                    curLocation);
+  RAW_LOG(INFO, "data race found at mem addr: %lx\n %s@[%p]line:%d vs "
+          "%s@[%p]line:%d", racePair.minAddr,
+          prevLocation.file ? prevLocation.file->c_str() : "",
+          racePair.instnAddrPrev, prevLocation.line,
+          curLocation.file ? curLocation.file->c_str() : "",
+          racePair.instnAddrCur, curLocation.line);
+}
+
+/*
+ * Fold races of one instruction pair into its entry. A pair is reported at
+ * runtime the first time it is seen. Runs on the reporter thread, or on
+ * the stopping thread once the reporter is joined.
+ */
+static void aggregateRacePair(const RacePair& races) {
+  auto& racePair = gRacePairs[RacePairKey(races.instnAddrPrev,
+                                          races.instnAddrCur)];
+  auto isNewPair = racePair.count == 0;
+  racePair.count += races.count;
+  racePair.minAddr = std::min(racePair.minAddr, races.minAddr);
+  racePair.maxAddr = std::max(racePair.maxAddr, races.maxAddr);
+  if (isNewPair) {
+    racePair.instnAddrPrev = races.instnAddrPrev;
+    racePair.instnAddrCur = races.instnAddrCur;
+    racePair.prevIsWrite = races.prevIsWrite;
+    racePair.curIsWrite = races.curIsWrite;
+    if (gReportAtRuntime) {
+      reportNewRacePair(racePair);
+    }
+  }
+}
+
+/*
+ * Fold one racing memory location into `racePair`, which is empty or 
+ * holds races of the same instruction pair.
+ */
+static void addRaceToPair(const DataRaceInfo& info, RacePair& racePair) {
+  if (racePair.count == 0) {
+    racePair.instnAddrPrev = info.instnAddrPrev;
+    racePair.instnAddrCur = info.instnAddrCur;
+    racePair.prevIsWrite = info.prevIsWrite;
+    racePair.curIsWrite = info.curIsWrite;
+  }
+  racePair.count++;
+  racePair.minAddr = std::min(racePair.minAddr, info.memAddr);
+  racePair.maxAddr = std::max(racePair.maxAddr, info.memAddr);
+}
+
+static void aggregateDataRace(const DataRaceInfo& info) {
+  RacePair racePair;
+  addRaceToPair(info, racePair);
+  aggregateRacePair(racePair);
+}
+
+/*
+ * Fold a race into the owner's pair buffer. Return false if the buffer is
+ * full and the pair is not in it. Runs on the owner thread only.
+ */
+static bool bufferDataRace(RaceQueue* queue, const DataRaceInfo& info) {
+  auto hash = RacePairKeyHash()(RacePairKey(info.instnAddrPrev, 
+                                            info.instnAddrCur));
+  for (uint64_t i = 0; i < RACE_BUFFER_CAPACITY; ++i) {
+    auto& racePair = queue->pairs[(hash + i) & (RACE_BUFFER_CAPACITY - 1)];
+    if (racePair.count == 0) {
+      // kept at most half full, so probes stay short
+      if (queue->numBuffered == RACE_BUFFER_CAPACITY / 2) {
+        return false;
+      }
+      queue->numBuffered++;
+      addRaceToPair(info, racePair);
+      return true;
+    }
+    if (racePair.instnAddrPrev == info.instnAddrPrev && 
+        racePair.instnAddrCur == info.instnAddrCur) {
+      addRaceToPair(info, racePair);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Consume all races published so far. Return the number of races consumed.
+ */
+static uint64_t drainRaceQueues() {
+  std::vector<RaceQueue*> queues;
+  {
+    McsNode node;
+    LockGuard guard(&gRaceQueuesLock, &node);
+    queues = gRaceQueues;
+  }
+  uint64_t numDrained = 0;
+  for (auto queue : queues) {
+    auto head = queue->head.load(std::memory_order_relaxed);
+    auto tail = queue->tail.load(std::memory_order_acquire);
+    for (auto i = head; i < tail; ++i) {
+      aggregateDataRace(queue->slots[i & (RACE_QUEUE_CAPACITY - 1)]);
+    }
+    queue->head.store(tail, std::memory_order_release);
+    numDrained += tail - head;
+  }
+  return numDrained;
+}
+
+static void runRaceReporter() {
+  while (!gReporterStop.load(std::memory_order_acquire)) {
+    if (drainRaceQueues() == 0) {
+      std::unique_lock<std::mutex> lock(gReporterMutex);
+      gReporterCond.wait_for(lock,
+              std::chrono::milliseconds(REPORTER_POLL_INTERVAL_MS));
+    }
+  }
+}
+
+/*
+ * Start the reporter thread if races are recorded for the final report or
+ * reported at runtime. Otherwise only per thread race counts are kept.
+ */
+void startRaceReporter(bool recordRaces, bool reportAtRuntime,
+                       bool reportLineInfo) {
+  gRecordRaces = recordRaces;
+  gReportAtRuntime = reportAtRuntime;
+  gReportLineInfo = reportLineInfo;
+  if (!recordRaces && !reportAtRuntime) {
+    return;
+  }
+  gQueuedPairs = new RacePairCounter(QUEUED_PAIR_CAPACITY_BITS);
+  gReporterStop.store(false);
+  gReporterThread = std::thread(runRaceReporter);
+  gReporterRunning.store(true, std::memory_order_release);
+}
+
+/*
+ * Stop the reporter thread and consume the races left in the queues and 
+ * pair buffers. Once `gReporterRunning` is cleared, owners drop new races,
+ * so the only races left to consume are the ones being published, which 
+ * are waited for.
+ */
+void stopRaceReporter() {
+  if (gReporterRunning.load()) {
+    gReporterRunning.store(false);
+    gReporterStop.store(true, std::memory_order_release);
+    wakeReporter();
+    gReporterThread.join();
+    std::vector<RaceQueue*> queues;
+    {
+      McsNode node;
+      LockGuard guard(&gRaceQueuesLock, &node);
+      queues = gRaceQueues;
+    }
+    for (auto queue : queues) {
+      while (queue->publishing.load()) {
+        std::this_thread::yield();
+      }
+    }
+    drainRaceQueues();
+    for (auto queue : queues) {
+      for (const auto& racePair : queue->pairs) {
+        if (racePair.count > 0) {
+          aggregateRacePair(racePair);
+        }
+      }
+    }
+  }
+  McsNode node;
+  LockGuard guard(&gRaceQueuesLock, &node);
+  for (size_t i = 0; i < gRaceQueues.size(); ++i) {
+    auto numRaces = gRaceQueues[i]->numRaces.load();
+    auto numLimited = gRaceQueues[i]->numLimited.load();
+    auto numDropped = gRaceQueues[i]->numDropped.load();
+    if (numRaces > 0) {
+      LOG(INFO) << "thread " << i << " found " << numRaces << " races, "
+                << numLimited << " not reported over the per pair limit";
+    }
+    if (numDropped > 0) {
+      LOG(WARNING) << "thread " << i << " dropped " << numDropped
+                   << " races found while its race queue and pair buffer "
+                   << "were full or after the reporter stopped";
+    }
+  }
+}
+
+/*
+ * Called with the access history lock held when a data race is found. The
+ * race is counted in the thread's own queue. The first race of a pair is 
+ * published to the reporter, other races are folded into the thread's 
+ * pair buffer, neither takes a lock or waits. A race is only counted as 
+ * dropped if the reporter stopped, or if the queue is full and the buffer
+ * has no room for its pair.
+ */
+void recordDataRace(const DataRaceInfo& info) {
+  auto queue = getThreadRaceQueue();
+  queue->numRaces.store(queue->numRaces.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+  if (!gRecordRaces && !gReportAtRuntime) {
+    return;
+  }
+  if (!shouldReportRacePair(info.instnAddrPrev, info.instnAddrCur)) {
+    queue->numLimited.store(
+            queue->numLimited.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+    return;
+  }
+  // pairs with the store and load in `stopRaceReporter`: either the stop 
+  // is seen here, or the stopping thread waits for this race to be published
+  queue->publishing.store(true);
+  if (!gReporterRunning.load()) {
+    queue->publishing.store(false, std::memory_order_release);
+    queue->numDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto isNewPair = gQueuedPairs->increment(
+          reinterpret_cast<uint64_t>(info.instnAddrPrev),
+          reinterpret_cast<uint64_t>(info.instnAddrCur)) == 1;
+  auto tail = queue->tail.load(std::memory_order_relaxed);
+  auto isFull = tail - queue->head.load(std::memory_order_acquire) >= 
+                RACE_QUEUE_CAPACITY;
+  if (isNewPair && !isFull) {
+    queue->slots[tail & (RACE_QUEUE_CAPACITY - 1)] = info;
+    queue->tail.store(tail + 1, std::memory_order_release);
+  } else if (!bufferDataRace(queue, info)) {
+    queue->numDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  queue->publishing.store(false, std::memory_order_release);
+  if (isFull) {
+    // the reporter polls, a lost notification only delays it
+    gReporterCond.notify_one();
+  }
+}
+
+uint64_t getNumDataRace() {
+  McsNode node;
+  LockGuard guard(&gRaceQueuesLock, &node);
+  uint64_t numDataRace = 0;
+  for (auto queue : gRaceQueues) {
+    numDataRace += queue->numRaces.load(std::memory_order_relaxed);
+  }
+  return numDataRace;
+}
+
+/*
+ * Return all race pairs, the ones racing on most locations first. Called
+ * at finalization after the reporter is stopped.
+ */
+std::vector<RacePair> collectRacePairs() {
+  std::vector<RacePair> racePairs;
+  racePairs.reserve(gRacePairs.size());
+  for (const auto& entry : gRacePairs) {
+    racePairs.push_back(entry.second);
+  }
+  std::sort(racePairs.begin(), racePairs.end(),
+            [](const RacePair& a, const RacePair& b) {
+              if (a.count != b.count) {
+                return a.count > b.count;
+              }
+              return a.instnAddrCur < b.instnAddrCur;
+            });
+  return racePairs;
+}
+
+/*
+ * Symbolize instruction addresses of all race pairs. Each address is
+ * resolved once no matter how many pairs it is involved in. `instnAddrs`
+ * is sorted and `locations` is indexed like it.
+ */
+static bool symbolizeRacePairs(const std::vector<RacePair>& racePairs,
+                               std::vector<uint64_t>& instnAddrs,
+                               std::vector<SourceLocation>& locations) {
+  auto& symbolizer = getSymbolizer();
+  if (!symbolizer.open()) {
+    return false;
+  }
+  instnAddrs.reserve(racePairs.size() * 2);
+  for (const auto& racePair : racePairs) {
+    instnAddrs.push_back(reinterpret_cast<uint64_t>(racePair.instnAddrPrev));
+    instnAddrs.push_back(reinterpret_cast<uint64_t>(racePair.instnAddrCur));
+  }
+  std::sort(instnAddrs.begin(), instnAddrs.end());
+  instnAddrs.erase(std::unique(instnAddrs.begin(), instnAddrs.end()),
+                   instnAddrs.end());
+  symbolizer.resolve(instnAddrs, locations);
+  return true;
+}
+
+static const SourceLocation& findLocation(
+        const std::vector<uint64_t>& instnAddrs,
+        const std::vector<SourceLocation>& locations,
+        void* instnAddr) {
+  auto it = std::lower_bound(instnAddrs.begin(), instnAddrs.end(),
+                             reinterpret_cast<uint64_t>(instnAddr));
+  return locations[it - instnAddrs.begin()];
+}
+
+static void formatLocation(const SourceLocation& location, void* instnAddr,
+                           char* buffer, size_t length) {
+  snprintf(buffer, length, "%s@[%p]line:%d col:%d",
+           location.file ? location.file->c_str() : "", instnAddr,
+           location.line, location.column);
+}
+
+/*
+ * Report data races with line information, one line per instruction pair.
+ */
+void reportDataRacesWithLineInfo(const std::vector<RacePair>& racePairs) {
+  std::vector<uint64_t> instnAddrs;
+  std::vector<SourceLocation> locations;
+  if (!symbolizeRacePairs(racePairs, instnAddrs, locations)) {
+    RAW_LOG(WARNING, "line info is not available");
+    for (const auto& racePair : racePairs) {
+      reportDataRace(racePair.instnAddrPrev, racePair.instnAddrCur,
+                     racePair.minAddr);
+    }
+    return;
+  }
+  for (size_t i = 0; i < instnAddrs.size(); ++i) {
+    if (!locations[i].file) {
+      RAW_LOG(WARNING, "cannot get source line info for instn addr: %lx",
+              instnAddrs[i]);
+    }
+  }
+  char prevBuffer[PATH_MAX + 64];
+  char curBuffer[PATH_MAX + 64];
+  for (const auto& racePair : racePairs) {
+    const auto& prevLocation = findLocation(instnAddrs, locations,
+                                            racePair.instnAddrPrev);
+    const auto& curLocation = findLocation(instnAddrs, locations,
+                                           racePair.instnAddrCur);
+    formatLocation(prevLocation, racePair.instnAddrPrev, prevBuffer,
+                   sizeof(prevBuffer));
+    formatLocation(curLocation, racePair.instnAddrCur, curBuffer,
+                   sizeof(curBuffer));
+    RAW_LOG(INFO, "data race at %lu locations in [%lx, %lx]\n %s vs %s",
+            racePair.count, racePair.minAddr, racePair.maxAddr,
+            prevBuffer, curBuffer);
+  }
+}
+
+static void writeJsonString(std::ofstream& output, const std::string& str) {
+  output << '"';
+  for (auto c : str) {
+    switch (c) {
+      case '"':
+        output << "\\\"";
+        break;
+      case '\\':
+        output << "\\\\";
+        break;
+      case '\n':
+        output << "\\n";
+        break;
+      case '\t':
+        output << "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          output << escaped;
+        } else {
+          output << c;
+        }
+    }
+  }
+  output << '"';
+}
+
+static void writeJsonAccess(std::ofstream& output, void* instnAddr,
+                            bool isWrite, const SourceLocation* location) {
+  char addrBuffer[32];
+  snprintf(addrBuffer, sizeof(addrBuffer), "0x%lx",
+           reinterpret_cast<uint64_t>(instnAddr));
+  output << "{\"instn\": \"" << addrBuffer << "\", \"access\": \""
+         << (isWrite ? "write" : "read") << "\"";
+  if (location && location->file) {
+    output << ", \"file\": ";
+    writeJsonString(output, *(location->file));
+    output << ", \"line\": " << location->line << ", \"column\": "
+           << location->column;
+  }
+  output << "}";
+}
+
+/*
+ * Write race pairs as a json document to `reportPath`. Line info is
+ * included when the executable has it.
+ */
+bool writeJsonReport(const std::string& reportPath,
+                     const std::vector<RacePair>& racePairs,
+                     uint64_t numDataRace) {
+  std::ofstream output(reportPath, std::ios::trunc);
+  if (!output.is_open()) {
+    LOG(WARNING) << "cannot open race report file: " << reportPath;
+    return false;
+  }
+  std::vector<uint64_t> instnAddrs;
+  std::vector<SourceLocation> locations;
+  auto hasLineInfo = symbolizeRacePairs(racePairs, instnAddrs, locations);
+  output << "{\n  \"numDataRace\": " << numDataRace << ",\n"
+         << "  \"numRacePairs\": " << racePairs.size() << ",\n"
+         << "  \"racePairs\": [";
+  char rangeBuffer[64];
+  for (size_t i = 0; i < racePairs.size(); ++i) {
+    const auto& racePair = racePairs[i];
+    const SourceLocation* prevLocation = nullptr;
+    const SourceLocation* curLocation = nullptr;
+    if (hasLineInfo) {
+      prevLocation = &findLocation(instnAddrs, locations,
+                                   racePair.instnAddrPrev);
+      curLocation = &findLocation(instnAddrs, locations,
+                                  racePair.instnAddrCur);
+    }
+    output << (i == 0 ? "\n" : ",\n") << "    {\"prev\": ";
+    writeJsonAccess(output, racePair.instnAddrPrev, racePair.prevIsWrite,
+                    prevLocation);
+    output << ", \"cur\": ";
+    writeJsonAccess(output, racePair.instnAddrCur, racePair.curIsWrite,
+                    curLocation);
+    snprintf(rangeBuffer, sizeof(rangeBuffer),
+             "\"minAddr\": \"0x%lx\", \"maxAddr\": \"0x%lx\"",
+             racePair.minAddr, racePair.maxAddr);
+    output << ", \"count\": " << racePair.count << ", " << rangeBuffer << "}";
+  }
+  output << "\n  ]\n}\n";
+  if (!output) {
+    LOG(WARNING) << "failed writing race report file: " << reportPath;
+    return false;
+  }
+  LOG(INFO) << "race report written to: " << reportPath;
+  return true;
+}
+
+}
@@ -61,4 +61,14 @@ void* Record::getInstnAddr() const {
 void* Record::getTaskPtr() const {
   return _taskPtr;
 }
+
+/*
+ * Records are equal if they describe the same access of the same task 
+ * segment under the same lock set.
+ */
+bool Record::operator==(const Record& other) const {
+  return _state == other._state && _label == other._label && 
+         _lockSet == other._lockSet && _taskPtr == other._taskPtr && 
+         _instnAddr == other._instnAddr;
+}
 }
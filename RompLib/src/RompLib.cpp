@@ -1,17 +1,30 @@
+#include <algorithm>
+#include <atomic>
 #include <experimental/filesystem>
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 #include <limits.h>
+#include <thread>
+#include <type_traits>
 #include <unistd.h>
 
 #include "AccessHistory.h"
+#include "AdaptiveCell.h"
 #include "Core.h"
 #include "CoreUtil.h"
 #include "DataSharing.h"
 #include "Initialize.h"
+#include "InstnProfile.h"
 #include "Label.h"
 #include "LockSet.h"
+#include "MemoryBudget.h"
+#include "RaceFilter.h"
+#include "RaceReport.h"
+#include "ShadowAccess.h"
 #include "ShadowMemory.h"
+#include "StaticData.h"
+#include "Stats.h"
+#include "Symbolizer.h"
 #include "TaskData.h"
 #include "ThreadData.h"
 
@@ -22,18 +35,106 @@ namespace romp {
 using LabelPtr = std::shared_ptr<Label>;
 using LockSetPtr = std::shared_ptr<LockSet>;
 
-ShadowMemory<AccessHistory> shadowMemory;
+template<Granularity G>
+using ShadowSlot = typename std::conditional<G == eAdaptiveLevel, 
+        AdaptiveCell, AccessHistory>::type;
+
+template<Granularity G>
+ShadowMemory<ShadowSlot<G>, G>* gShadowMemory = nullptr;
+
+typedef void (*CheckAccessFunc)(void* address, uint32_t bytesAccessed, 
+                                void* instnAddr, bool hwLock, bool isWrite);
+typedef void (*RecycleRangeFunc)(uint64_t start, uint64_t end);
+typedef void (*ShrinkShadowFunc)(uint64_t limit);
+typedef ShadowRegion* (*MapRegionFunc)(uint64_t start, uint64_t end);
+typedef void (*UnmapRegionFunc)(ShadowRegion* region);
+typedef uint64_t (*ShadowUsageFunc)();
+typedef void (*MaintainShadowFunc)();
+
+static CheckAccessFunc gCheckAccessFunc = nullptr;
+static RecycleRangeFunc gRecycleRangeFunc = nullptr;
+static RecycleRangeFunc gReleaseRangeFunc = nullptr;
+static ShrinkShadowFunc gEvictPagesFunc = nullptr;
+static ShrinkShadowFunc gTruncateHistoriesFunc = nullptr;
+static MapRegionFunc gMapRegionFunc = nullptr;
+static UnmapRegionFunc gUnmapRegionFunc = nullptr;
+static ShadowUsageFunc gHugeBackedBytesFunc = nullptr;
+static MaintainShadowFunc gMaintainShadowFunc = nullptr;
+
+/*
+ * Heap blocks are released from any thread at any time, while maintenance,
+ * eviction and truncation assume nothing else touches the shadow memory. A
+ * release announces itself in `gNumShadowReleases` and backs off while 
+ * maintenance runs, maintenance waits for announced releases to finish. 
+ * Blocks freed by the maintaining thread are romp's own, they have no 
+ * shadow and are not released.
+ */
+static std::atomic<uint64_t> gNumShadowReleases(0);
+static std::atomic_bool gInShadowMaintenance(false);
+static thread_local bool tInShadowMaintenance 
+        __attribute__((tls_model("initial-exec"))) = false;
+
+class ShadowMaintenanceGuard {
+public:
+  ShadowMaintenanceGuard() {
+    while (gInShadowMaintenance.exchange(true)) {
+      std::this_thread::yield();
+    }
+    while (gNumShadowReleases.load() > 0) {
+      std::this_thread::yield();
+    }
+    tInShadowMaintenance = true;
+  }
+  ~ShadowMaintenanceGuard() {
+    tInShadowMaintenance = false;
+    gInShadowMaintenance.store(false);
+  }
+};
+
+// shadow regions of the executable's writable segments
+static ShadowRegion* gStaticShadows[MAX_STATIC_SHADOWS];
+static int gNumStaticShadows = 0;
+
+static inline const ShadowRegion* findStaticShadow(uint64_t address) {
+  for (int i = 0; i < gNumStaticShadows; ++i) {
+    auto region = gStaticShadows[i];
+    if (address >= region->ownedStart && address < region->ownedEnd) {
+      return region;
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * Append `record` and account the growth of the record storage. Over the 
+ * memory budget, a record that would grow the storage is dropped.
+ */
+static inline void appendRecord(std::vector<Record>* records, 
+                                const Record& record) {
+  auto capacity = records->capacity();
+  if (records->size() == capacity && overMemoryBudget()) {
+    countBudgetEvent(eBudgetRecordsDropped);
+    return;
+  }
+  records->push_back(record);
+  if (records->capacity() != capacity) {
+    chargeMemory(eMemRecords, 
+            (records->capacity() - capacity) * sizeof(Record));
+  }
+}
 
 /*
  * Driver function to do data race checking and access history management.
+ * The caller holds the lock of the access history.
  */
-void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel, 
-                   const LockSetPtr& curLockSet, const CheckInfo& checkInfo) {
-  McsNode node;
-  LockGuard guard(&(accessHistory->getLock()), &node);
+void checkDataRaceLocked(AccessHistory* accessHistory, 
+                         const LabelPtr& curLabel, 
+                         const LockSetPtr& curLockSet, 
+                         const CheckInfo& checkInfo) {
   auto dataSharingType = checkInfo.dataSharingType;
   if (dataSharingType == eThreadPrivateBelowExit || 
           dataSharingType == eStaticThreadPrivate) {
+    addStat(eStatExitThreadPrivate);
     return;
   }
   auto records = accessHistory->getRecords();
@@ -48,6 +149,7 @@ void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel,
     if (!records->empty()) {
       records->clear();
     }
+    addStat(eStatExitRaceFound);
     return;
   }
   if (accessHistory->memIsRecycled()) {
@@ -57,16 +159,23 @@ void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel,
      */
      accessHistory->clearFlags();
      records->clear();
+     addStat(eStatExitRecycled);
      return;
   }
   if (isDupMemAccess(checkInfo)) {
+    addStat(eStatExitDupAccess);
     return;
   }
+  recordHistoryLength(records->size());
+  if (checkInfo.instnCounters) {
+    checkInfo.instnCounters->numHistoryChecks++;
+    checkInfo.instnCounters->historyLenSum += records->size();
+  }
   auto curRecord = Record(checkInfo.isWrite, curLabel, curLockSet, 
           checkInfo.taskPtr, checkInfo.instnAddr, checkInfo.hwLock);
   if (records->empty()) {
     // no access record, add current access to the record
-    records->push_back(curRecord);
+    appendRecord(records, curRecord);
   } else {
     // check previous access records with current access
     auto isHistBeforeCurrent = false;
@@ -77,20 +186,19 @@ void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel,
     while (it != records->end()) {
       cit = it; 
       auto histRecord = *cit;
-      if (analyzeRaceCondition(histRecord, curRecord, isHistBeforeCurrent, 
-                  diffIndex)) {
-        gDataRaceFound = true;
-        gNumDataRace++;
-        if (gReportLineInfo) {
-          McsNode node;	
-          LockGuard recordGuard(&gDataRaceLock, &node);
-          gDataRaceRecords.push_back(DataRaceInfo(histRecord.getInstnAddr(),
-                                                  curRecord.getInstnAddr(),
-                                                  checkInfo.byteAddress));
-        } else if (gReportAtRuntime) {
-          reportDataRace(histRecord.getInstnAddr(), curRecord.getInstnAddr(),
-                         checkInfo.byteAddress);
-        }
+      auto isRace = analyzeRaceCondition(histRecord, curRecord, 
+              isHistBeforeCurrent, diffIndex);
+      if (gProfileInstn) {
+        profileAccessPair(histRecord, curRecord, checkInfo.instnCounters, 
+                isRace);
+      }
+      if (isRace) {
+        markRacyInstns(histRecord.getInstnAddr(), curRecord.getInstnAddr());
+        recordDataRace(DataRaceInfo(histRecord.getInstnAddr(),
+                                    curRecord.getInstnAddr(),
+                                    checkInfo.byteAddress,
+                                    histRecord.isWrite(),
+                                    curRecord.isWrite()));
         accessHistory->setFlag(eDataRaceFound);  
 	break;
       }
@@ -102,8 +210,396 @@ void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel,
       modifyAccessHistory(decision, records, it);
     }
     if (!skipAddCur) {
-      records->push_back(curRecord); 
+      appendRecord(records, curRecord); 
+    }
+  }
+}
+
+void checkDataRace(AccessHistory* accessHistory, const LabelPtr& curLabel, 
+                   const LockSetPtr& curLockSet, const CheckInfo& checkInfo) {
+  McsNode node;
+  LockGuard guard(&(accessHistory->getLock()), &node);
+  checkDataRaceLocked(accessHistory, curLabel, curLockSet, checkInfo);
+}
+
+/*
+ * Check the bytes [start, end) of one adaptive cell starting at 
+ * `cellAddress`. An access covering the whole cell of a coarse cell is 
+ * checked once against the coarse history. Any other access splits the cell
+ * and is checked byte by byte.
+ */
+void checkAdaptiveCell(AdaptiveCell* cell, uint64_t cellAddress, 
+                       uint64_t start, uint64_t end, const LabelPtr& curLabel,
+                       const LockSetPtr& curLockSet, CheckInfo& checkInfo) {
+  if (!cell->isSplit()) {
+    auto& coarse = cell->getCoarseHistory();
+    McsNode node;
+    LockGuard guard(&(coarse.getLock()), &node);
+    // re-check under the lock, another thread may have split the cell
+    if (!cell->isSplit()) {
+      if (start == cellAddress && end == cellAddress + CELL_BYTES) {
+        checkInfo.byteAddress = cellAddress;
+        checkDataRaceLocked(&coarse, curLabel, curLockSet, checkInfo);
+        return;
+      }
+      cell->split();
+    }
+  }
+  auto fine = cell->getFineHistories();
+  for (auto curAddress = start; curAddress < end; ++curAddress) {
+    checkInfo.byteAddress = curAddress;
+    checkDataRace(&fine[curAddress - cellAddress], curLabel, curLockSet, 
+                  checkInfo);
+  }
+}
+
+/*
+ * Check one instrumented access against the shadow memory of granularity G.
+ * Every slot covered by the access is checked once, with the slot's first 
+ * address as the memory address.
+ */
+template<Granularity G>
+void checkAccessImpl(void* address,
+                     uint32_t bytesAccessed,
+                     void* instnAddr,
+                     bool hwLock,
+                     bool isWrite) {
+  AllTaskInfo allTaskInfo;
+  int threadNum = -1;
+  int taskType = -1;
+  int teamSize = -1;
+  void* curThreadData = nullptr;
+  void* curParRegionData = nullptr;
+  if (!prepareAllInfo(taskType, teamSize, threadNum, curParRegionData, 
+              curThreadData, allTaskInfo)) {
+    return;
+  }
+  InstnCounters* instnCounters = nullptr;
+  if (gProfileInstn) {
+    instnCounters = &getInstnCounters(instnAddr);
+    instnCounters->numChecks++;
+    instnCounters->bytesChecked += bytesAccessed;
+    instnCounters->isWrite |= isWrite;
+  }
+  if (taskType == ompt_task_initial) { 
+    // don't check data race for initial task
+    if (instnCounters) {
+      instnCounters->numSerial++;
+    }
+    addStat(eStatExitInitialTask);
+    return;
+  }
+  // query data  
+  auto dataSharingType = analyzeDataSharing(curThreadData, address, 
+                                           allTaskInfo.taskFrame);
+  if (instnCounters) {
+    if (dataSharingType == eThreadPrivateBelowExit || 
+        dataSharingType == eStaticThreadPrivate) {
+      instnCounters->numThreadPrivate++;
+    } else {
+      instnCounters->numShared++;
+    }
+  }
+  if (!allTaskInfo.taskData->ptr) {
+    RAW_LOG(WARNING, "pointer to current task data is null");
+    return;
+  }
+  auto curTaskData = static_cast<TaskData*>(allTaskInfo.taskData->ptr);
+  curTaskData->exitFrame = allTaskInfo.taskFrame->exit_frame.ptr;
+  auto& curLabel = curTaskData->label;
+  auto& curLockSet = curTaskData->lockSet;
+  
+  CheckInfo checkInfo(allTaskInfo, bytesAccessed, instnAddr, 
+          static_cast<void*>(curTaskData), taskType, isWrite, hwLock, 
+          dataSharingType);
+  checkInfo.instnCounters = instnCounters;
+  // one check per shadow slot overlapping [address, address + bytesAccessed)
+  constexpr auto slotBytes = 
+      ShadowMemory<ShadowSlot<G>, G>::getGranularityBytes();
+  auto shadowMemory = gShadowMemory<G>;
+  auto startAddress = reinterpret_cast<uint64_t>(address);
+  // the own stack and static data have preallocated shadow regions
+  const ShadowRegion* region = nullptr;
+  if (dataSharingType == eThreadPrivateAboveExit) {
+    region = static_cast<ThreadData*>(curThreadData)->stackShadow;
+  } else if (dataSharingType == eNonThreadPrivate) {
+    region = findStaticShadow(startAddress);
+  }
+  auto endAddress = startAddress + bytesAccessed;
+  auto curAddress = startAddress & ~(slotBytes - 1);
+  for (; curAddress < endAddress; curAddress += slotBytes) {
+    ShadowSlot<G>* slot = nullptr;
+    if (region) {
+      slot = shadowMemory->getRegionSlot(region, curAddress);
+    }
+    // over the memory budget, memory without shadow pages is not checked
+    if (!slot) {
+      slot = overMemoryBudget() ? 
+          shadowMemory->findShadowMemorySlot(curAddress) :
+          shadowMemory->getShadowMemorySlot(curAddress);
+    }
+    if (!slot) {
+      countBudgetEvent(eBudgetAccessesSkipped);
+      continue;
+    }
+    if constexpr (G == eAdaptiveLevel) {
+      checkAdaptiveCell(slot, curAddress, std::max(curAddress, startAddress),
+              std::min(curAddress + slotBytes, endAddress), curLabel, 
+              curLockSet, checkInfo);
+    } else {
+      checkInfo.byteAddress = curAddress;
+      checkDataRace(slot, curLabel, curLockSet, checkInfo);
+    }
+  }
+}
+
+/*
+ * Mark existing access histories in [start, end] as recycled. Slots that are
+ * only partially covered by the range are recycled as a whole.
+ */
+template<Granularity G>
+void recycleRangeImpl(uint64_t start, uint64_t end) {
+  gShadowMemory<G>->forEachSlotInRange(start, end, 
+      [](ShadowSlot<G>* slot) {
+        if constexpr (G == eAdaptiveLevel) {
+          slot->setFlag(eMemoryRecycled);
+        } else {
+          McsNode node;
+          LockGuard guard(&(slot->getLock()), &node);
+          slot->setFlag(eMemoryRecycled);
+        }
+      });
+}
+
+/*
+ * Drop the access histories in [start, end] and give fully covered shadow 
+ * pages back to the page pool.
+ */
+template<Granularity G>
+void releaseRangeImpl(uint64_t start, uint64_t end) {
+  gShadowMemory<G>->releaseRange(start, end, 
+      [](ShadowSlot<G>* slot) {
+        if constexpr (G == eAdaptiveLevel) {
+          slot->reset();
+        } else {
+          McsNode node;
+          LockGuard guard(&(slot->getLock()), &node);
+          slot->reset();
+        }
+      });
+}
+
+template<Granularity G>
+void evictColdPagesImpl(uint64_t bytesToFree) {
+  auto numEvicted = gShadowMemory<G>->evictColdPages(bytesToFree);
+  countBudgetEvent(eBudgetPagesEvicted, numEvicted);
+}
+
+/*
+ * Truncate every access history to its `maxLen` most recent records. Only 
+ * called while no access is being checked, so slots are not locked.
+ */
+template<Granularity G>
+void truncateHistoriesImpl(uint64_t maxLen) {
+  uint64_t numHistories = 0;
+  uint64_t numRecords = 0;
+  gShadowMemory<G>->forEachSlot([&](ShadowSlot<G>* slot) {
+    auto numDropped = slot->truncate(maxLen);
+    if (numDropped > 0) {
+      numHistories++;
+      numRecords += numDropped;
+    }
+  });
+  countBudgetEvent(eBudgetHistoriesTruncated, numHistories);
+  countBudgetEvent(eBudgetRecordsTruncated, numRecords);
+}
+
+template<Granularity G>
+ShadowRegion* mapRegionImpl(uint64_t start, uint64_t end) {
+  return gShadowMemory<G>->mapShadowRegion(start, end);
+}
+
+template<Granularity G>
+void unmapRegionImpl(ShadowRegion* region) {
+  gShadowMemory<G>->unmapShadowRegion(region);
+}
+
+template<Granularity G>
+void maintainShadowImpl() {
+  gShadowMemory<G>->promoteSparsePages();
+  gShadowMemory<G>->compressColdPages();
+  gShadowMemory<G>->chargeShadowRegions();
+}
+
+template<Granularity G>
+uint64_t hugeBackedBytesImpl() {
+  return gShadowMemory<G>->getHugeBackedBytes();
+}
+
+/*
+ * The l2 page table takes the address bits between the l1 index and the 
+ * offset into a shadow page.
+ */
+template<Granularity G>
+void setupShadowMemory(const ShadowConfig& config) {
+  const uint64_t numMemAddrBits = 48;
+  auto l2PageTableBits = numMemAddrBits - SHADOW_L1_PAGE_TABLE_BITS - 
+                         config.pageBits;
+  gShadowMemory<G> = new ShadowMemory<ShadowSlot<G>, G>(
+          SHADOW_L1_PAGE_TABLE_BITS, l2PageTableBits, numMemAddrBits);
+  if (gMemoryBudgetEnabled) {
+    gShadowMemory<G>->enableReferenceTracking();
+  }
+  gShadowMemory<G>->setHugePageMode(config.hugePageMode);
+  gShadowMemory<G>->setBackend(config.backend);
+  if (config.compressAfter > 0) {
+    gShadowMemory<G>->enableCompression(config.compressAfter);
+  }
+  gCheckAccessFunc = &checkAccessImpl<G>;
+  gRecycleRangeFunc = &recycleRangeImpl<G>;
+  gReleaseRangeFunc = &releaseRangeImpl<G>;
+  gEvictPagesFunc = &evictColdPagesImpl<G>;
+  gTruncateHistoriesFunc = &truncateHistoriesImpl<G>;
+  gMapRegionFunc = &mapRegionImpl<G>;
+  gUnmapRegionFunc = &unmapRegionImpl<G>;
+  gHugeBackedBytesFunc = &hugeBackedBytesImpl<G>;
+  gMaintainShadowFunc = &maintainShadowImpl<G>;
+}
+
+/*
+ * Called once from omptInitialize, before any access is checked.
+ */
+void configureShadowMemory(const ShadowConfig& config) {
+  switch (config.granularity) {
+    case eWordLevel:
+      setupShadowMemory<eWordLevel>(config);
+      break;
+    case eLongWordLevel:
+      setupShadowMemory<eLongWordLevel>(config);
+      break;
+    case eAdaptiveLevel:
+      setupShadowMemory<eAdaptiveLevel>(config);
+      break;
+    default:
+      setupShadowMemory<eByteLevel>(config);
+      break;
+  }
+}
+
+bool parseGranularity(const char* name, Granularity& granularity) {
+  auto value = std::string(name);
+  if (value == "byte" || value == "1") {
+    granularity = eByteLevel;
+  } else if (value == "word" || value == "4") {
+    granularity = eWordLevel;
+  } else if (value == "longword" || value == "8") {
+    granularity = eLongWordLevel;
+  } else if (value == "adaptive") {
+    granularity = eAdaptiveLevel;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool parseShadowBackend(const char* name, ShadowBackend& backend) {
+  auto value = std::string(name);
+  if (value == "page") {
+    backend = ePageBackend;
+  } else if (value == "hash") {
+    backend = eHashBackend;
+  } else if (value == "hybrid") {
+    backend = eHybridBackend;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Called from the quiescent points of CoreUtil, while no access is being
+ * checked.
+ */
+void maintainShadowMemory() {
+  if (gMaintainShadowFunc) {
+    ShadowMaintenanceGuard guard;
+    gMaintainShadowFunc();
+  }
+}
+
+uint64_t getHugeBackedShadowBytes() {
+  return gHugeBackedBytesFunc ? gHugeBackedBytesFunc() : 0;
+}
+
+void recycleShadowRange(uint64_t start, uint64_t end) {
+  if (gRecycleRangeFunc) {
+    gRecycleRangeFunc(start, end);
+  }
+}
+
+void releaseShadowRange(uint64_t start, uint64_t end) {
+  if (!gReleaseRangeFunc || tInShadowMaintenance) {
+    return;
+  }
+  gNumShadowReleases.fetch_add(1);
+  while (gInShadowMaintenance.load()) {
+    gNumShadowReleases.fetch_sub(1);
+    while (gInShadowMaintenance.load()) {
+      std::this_thread::yield();
     }
+    gNumShadowReleases.fetch_add(1);
+  }
+  gReleaseRangeFunc(start, end);
+  gNumShadowReleases.fetch_sub(1);
+}
+
+void evictColdShadowPages(uint64_t bytesToFree) {
+  if (gEvictPagesFunc) {
+    ShadowMaintenanceGuard guard;
+    gEvictPagesFunc(bytesToFree);
+  }
+}
+
+void truncateAccessHistories(uint64_t maxLen) {
+  if (gTruncateHistoriesFunc) {
+    ShadowMaintenanceGuard guard;
+    gTruncateHistoriesFunc(maxLen);
+  }
+}
+
+/*
+ * Map the shadow region of a thread stack, covering at most 
+ * MAX_STACK_SHADOW_SPAN bytes below the top.
+ */
+ShadowRegion* createStackShadow(void* stackBase, void* stackTop) {
+  if (!gMapRegionFunc) {
+    return nullptr;
+  }
+  auto top = reinterpret_cast<uint64_t>(stackTop);
+  auto span = std::min<uint64_t>(top - reinterpret_cast<uint64_t>(stackBase),
+                                 MAX_STACK_SHADOW_SPAN);
+  return gMapRegionFunc(top - span, top);
+}
+
+/*
+ * Map the shadow region of static data [start, end]. Called only during 
+ * initialization.
+ */
+bool createStaticShadow(uint64_t start, uint64_t end) {
+  if (!gMapRegionFunc || gNumStaticShadows == MAX_STATIC_SHADOWS) {
+    return false;
+  }
+  auto region = gMapRegionFunc(start, end);
+  if (!region) {
+    return false;
+  }
+  gStaticShadows[gNumStaticShadows++] = region;
+  return true;
+}
+
+void destroyShadowRegion(ShadowRegion* region) {
+  if (gUnmapRegionFunc && region) {
+    gUnmapRegionFunc(region);
   }
 }
 
@@ -125,10 +621,8 @@ ompt_start_tool_result_t* ompt_start_tool(
   }
   auto appPath = std::string(result, count);
   LOG(INFO) << "ompt_start_tool on executable: " << appPath;
-  //auto success = Dyninst::SymtabAPI::Symtab::openFile(gSymtabHandle, appPath);
-  //if (!success) {
-  //  LOG(FATAL) << "cannot parse executable into symtab: " << appPath;
-  //}
+  // line tables are parsed lazily, only when a data race is reported
+  getSymbolizer().setExecutablePath(appPath);
   return &startToolResult;
 }
 
@@ -146,41 +640,17 @@ void checkAccess(void* address,
     //RAW_LOG(INFO, "ompt not initialized yet");
     return;
   }
-  AllTaskInfo allTaskInfo;
-  int threadNum = -1;
-  int taskType = -1;
-  int teamSize = -1;
-  void* curThreadData = nullptr;
-  void* curParRegionData = nullptr;
-  if (!prepareAllInfo(taskType, teamSize, threadNum, curParRegionData, 
-              curThreadData, allTaskInfo)) {
-    return;
-  }
-  if (taskType == ompt_task_initial) { 
-    // don't check data race for initial task
+  CallbackTimer timer(eCbCheckAccess);
+  addStat(eStatCheckAccess);
+  if (isSuppressedInstn(instnAddr) || isRacyInstn(instnAddr)) {
+    addStat(eStatExitSuppressed);
     return;
   }
-  // query data  
-  auto dataSharingType = analyzeDataSharing(curThreadData, address, 
-                                           allTaskInfo.taskFrame);
-  if (!allTaskInfo.taskData->ptr) {
-    RAW_LOG(WARNING, "pointer to current task data is null");
+  if (isReadOnlyStatic(reinterpret_cast<uint64_t>(address))) {
+    addStat(eStatExitReadOnly);
     return;
   }
-  auto curTaskData = static_cast<TaskData*>(allTaskInfo.taskData->ptr);
-  curTaskData->exitFrame = allTaskInfo.taskFrame->exit_frame.ptr;
-  auto& curLabel = curTaskData->label;
-  auto& curLockSet = curTaskData->lockSet;
-  
-  CheckInfo checkInfo(allTaskInfo, bytesAccessed, instnAddr, 
-          static_cast<void*>(curTaskData), taskType, isWrite, hwLock, 
-          dataSharingType);
-  for (uint64_t i = 0; i < bytesAccessed; ++i) {
-    auto curAddress = reinterpret_cast<uint64_t>(address) + i;      
-    auto accessHistory = shadowMemory.getShadowMemorySlot(curAddress);
-    checkInfo.byteAddress = curAddress;
-    checkDataRace(accessHistory, curLabel, curLockSet, checkInfo);
-  }
+  gCheckAccessFunc(address, bytesAccessed, instnAddr, hwLock, isWrite);
 }
 
 }
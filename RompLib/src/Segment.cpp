@@ -5,6 +5,8 @@
 #include <glog/raw_logging.h>
 #include <sstream>
 
+#include "MemoryBudget.h"
+
 #define SEG_TYPE_MASK        0x0000000000000003
 #define OFFSET_MASK          0xffff000000000000
 #define SPAN_MASK            0x0000ffff00000000
@@ -38,6 +40,17 @@
 
 namespace romp {
 
+/*
+ * Every segment is charged at the size of the largest derived segment.
+ */
+Segment::Segment() {
+  chargeMemory(eMemLabels, sizeof(WorkShareSegment));
+}
+
+Segment::~Segment() {
+  chargeMemory(eMemLabels, -static_cast<int64_t>(sizeof(WorkShareSegment)));
+}
+
 /*
  * Each segment contains a 64 bit value. From low to high, assign index 0-63
  * [0,1]: segment type 
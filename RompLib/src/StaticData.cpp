@@ -0,0 +1,49 @@
+#include "StaticData.h"
+
+#include <elf.h>
+#include <glog/logging.h>
+#include <link.h>
+
+#include "ShadowAccess.h"
+
+namespace romp {
+
+int gNumReadOnlySegments = 0;
+AddressRange gReadOnlySegments[MAX_READ_ONLY_SEGMENTS];
+
+/*
+ * The first object reported by dl_iterate_phdr is the executable. Stop 
+ * after it.
+ */
+static int visitExecutable(struct dl_phdr_info* info, size_t /*size*/, 
+                           void* /*data*/) {
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const auto& header = info->dlpi_phdr[i];
+    if (header.p_type != PT_LOAD || header.p_memsz == 0) {
+      continue;
+    }
+    auto start = static_cast<uint64_t>(info->dlpi_addr + header.p_vaddr);
+    auto end = start + header.p_memsz;
+    if (header.p_flags & PF_W) {
+      if (createStaticShadow(start, end - 1)) {
+        LOG(INFO) << "static shadow for [" << std::hex << start << ", " 
+                  << end << ")";
+      }
+    } else if (gNumReadOnlySegments < MAX_READ_ONLY_SEGMENTS) {
+      gReadOnlySegments[gNumReadOnlySegments].start = start;
+      gReadOnlySegments[gNumReadOnlySegments].end = end;
+      gNumReadOnlySegments++;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Called once from omptInitialize, after the shadow memory is configured.
+ */
+void loadStaticSegments() {
+  dl_iterate_phdr(&visitExecutable, nullptr);
+  LOG(INFO) << gNumReadOnlySegments << " read only segments are not checked";
+}
+
+}
@@ -0,0 +1,186 @@
+#include "Stats.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <glog/logging.h>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace romp {
+
+bool gStatsEnabled = false;
+
+/*
+ * Registration uses std::mutex instead of McsLock, because McsLock itself
+ * updates the statistics.
+ */
+static std::mutex gThreadStatsLock;
+static std::vector<ThreadStats*> gThreadStats;
+static thread_local ThreadStats* tThreadStats = nullptr;
+
+static const char* gCounterNames[eNumStatCounters] = {
+  "checkAccess",
+  "exitSuppressed",
+  "exitReadOnly",
+  "exitInitialTask",
+  "exitThreadPrivate",
+  "exitRaceFound",
+  "exitRecycled",
+  "exitDupAccess",
+  "shadowPages",
+  "shadowChunks",
+  "shadowHugetlbChunks",
+  "shadowHugeBytes",
+  "shadowPagesReleased",
+  "shadowPagesReused",
+  "heapReclaims",
+  "sparseTables",
+  "sparsePromotions",
+  "pagesCompressed",
+  "pagesExpanded",
+  "cellSplits",
+  "happensBefore",
+  "hasPath",
+  "hasPathNodes",
+  "mcsAcquire",
+  "mcsContended",
+  "mcsSpins",
+};
+
+static const char* gCallbackNames[eNumStatCallbacks] = {
+  "checkAccess",
+  "implicit_task",
+  "sync_region",
+  "mutex_acquired",
+  "mutex_released",
+  "work",
+  "parallel_begin",
+  "parallel_end",
+  "task_create",
+  "task_schedule",
+  "dependences",
+  "thread_begin",
+  "thread_end",
+  "dispatch",
+  "reduction",
+};
+
+static const char* gHistoryLenNames[NUM_HISTORY_LEN_BUCKETS] = {
+  "0", "1", "2", "3-4", "5-8", "9-16", "17-32", "33+",
+};
+
+/*
+ * Thread stats are never freed, so counters of exited threads are kept.
+ */
+ThreadStats* getThreadStats() {
+  if (!tThreadStats) {
+    auto stats = new ThreadStats();
+    memset(stats, 0, sizeof(ThreadStats));
+    std::lock_guard<std::mutex> guard(gThreadStatsLock);
+    gThreadStats.push_back(stats);
+    tThreadStats = stats;
+  }
+  return tThreadStats;
+}
+
+uint64_t readCycleCounter() {
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void recordHistoryLength(uint64_t historyLen) {
+  if (!gStatsEnabled) {
+    return;
+  }
+  int bucket = 0;
+  if (historyLen > 32) {
+    bucket = NUM_HISTORY_LEN_BUCKETS - 1;
+  } else if (historyLen > 2) {
+    // 3-4 -> 3, 5-8 -> 4, 9-16 -> 5, 17-32 -> 6
+    bucket = 65 - __builtin_clzll(historyLen - 1);
+  } else {
+    bucket = static_cast<int>(historyLen);
+  }
+  getThreadStats()->historyLen[bucket]++;
+}
+
+/*
+ * Merge counters of all threads, log a summary and write `csvPath` as
+ * `kind,name,value` rows if it is not empty.
+ */
+void reportStats(const std::string& csvPath) {
+  ThreadStats total;
+  memset(&total, 0, sizeof(ThreadStats));
+  size_t numThreads = 0;
+  {
+    std::lock_guard<std::mutex> guard(gThreadStatsLock);
+    numThreads = gThreadStats.size();
+    for (auto stats : gThreadStats) {
+      for (int i = 0; i < eNumStatCounters; ++i) {
+        total.counters[i] += stats->counters[i];
+      }
+      for (int i = 0; i < eNumStatCallbacks; ++i) {
+        total.callbackCalls[i] += stats->callbackCalls[i];
+        total.callbackCycles[i] += stats->callbackCycles[i];
+      }
+      for (int i = 0; i < NUM_HISTORY_LEN_BUCKETS; ++i) {
+        total.historyLen[i] += stats->historyLen[i];
+      }
+    }
+  }
+  std::stringstream summary;
+  summary << "romp statistics of " << numThreads << " threads\n";
+  for (int i = 0; i < eNumStatCounters; ++i) {
+    summary << "  " << gCounterNames[i] << ": " << total.counters[i] << "\n";
+  }
+  summary << "  callback: calls cycles cycles/call\n";
+  for (int i = 0; i < eNumStatCallbacks; ++i) {
+    if (total.callbackCalls[i] == 0) {
+      continue;
+    }
+    summary << "  " << gCallbackNames[i] << ": " << total.callbackCalls[i]
+            << " " << total.callbackCycles[i] << " "
+            << total.callbackCycles[i] / total.callbackCalls[i] << "\n";
+  }
+  summary << "  history length:";
+  for (int i = 0; i < NUM_HISTORY_LEN_BUCKETS; ++i) {
+    summary << " [" << gHistoryLenNames[i] << "] " << total.historyLen[i];
+  }
+  LOG(INFO) << summary.str();
+  if (csvPath.empty()) {
+    return;
+  }
+  std::ofstream output(csvPath, std::ios::trunc);
+  if (!output.is_open()) {
+    LOG(WARNING) << "cannot open statistics file: " << csvPath;
+    return;
+  }
+  output << "kind,name,value\n";
+  output << "threads,all," << numThreads << "\n";
+  for (int i = 0; i < eNumStatCounters; ++i) {
+    output << "counter," << gCounterNames[i] << "," << total.counters[i]
+           << "\n";
+  }
+  for (int i = 0; i < eNumStatCallbacks; ++i) {
+    output << "callback_calls," << gCallbackNames[i] << ","
+           << total.callbackCalls[i] << "\n";
+    output << "callback_cycles," << gCallbackNames[i] << ","
+           << total.callbackCycles[i] << "\n";
+  }
+  for (int i = 0; i < NUM_HISTORY_LEN_BUCKETS; ++i) {
+    output << "history_len," << gHistoryLenNames[i] << ","
+           << total.historyLen[i] << "\n";
+  }
+  LOG(INFO) << "statistics written to: " << csvPath;
+}
+
+}
@@ -0,0 +1,183 @@
+#include "Symbolizer.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+#include <thread>
+#include <unordered_map>
+#include <Symtab.h>
+
+using namespace Dyninst;
+using namespace SymtabAPI;
+
+#define ADDRS_PER_RESOLVE_THREAD 4096
+#define MAX_OVERLAP_SCAN 8
+
+namespace romp {
+
+Symbolizer::Symbolizer(): symtab_(nullptr), opened_(false) {}
+
+void Symbolizer::setExecutablePath(const std::string& appPath) {
+  appPath_ = appPath;
+}
+
+/*
+ * Parse the line tables of the executable into the address index. Parsing
+ * happens at most once, later calls return the result of the first one.
+ */
+bool Symbolizer::open() {
+  std::call_once(openFlag_, [this]() {
+    if (appPath_.empty()) {
+      LOG(WARNING) << "executable path unknown, cannot symbolize";
+      return;
+    }
+    if (!Symtab::openFile(symtab_, appPath_)) {
+      LOG(WARNING) << "cannot parse executable into symtab: " << appPath_;
+      return;
+    }
+    std::vector<Module*> modules;
+    symtab_->getAllModules(modules);
+    std::unordered_map<std::string, uint32_t> fileIndices;
+    for (auto module : modules) {
+      std::vector<Statement::Ptr> statements;
+      if (!module->getStatements(statements)) {
+        continue;
+      }
+      for (const auto& statement : statements) {
+        if (statement->startAddr() >= statement->endAddr()) {
+          continue;
+        }
+        auto fileName = statement->getFile();
+        auto it = fileIndices.find(fileName);
+        if (it == fileIndices.end()) {
+          it = fileIndices.emplace(fileName, fileNames_.size()).first;
+          fileNames_.push_back(fileName);
+        }
+        lineEntries_.push_back(LineEntry{ statement->startAddr(),
+                statement->endAddr(), it->second,
+                static_cast<int>(statement->getLine()),
+                static_cast<int>(statement->getColumn()) });
+      }
+    }
+    std::sort(lineEntries_.begin(), lineEntries_.end(),
+              [](const LineEntry& a, const LineEntry& b) {
+                return a.start < b.start;
+              });
+    LOG(INFO) << "symbolizer indexed " << lineEntries_.size()
+              << " line entries of " << fileNames_.size() << " files";
+    opened_ = true;
+  });
+  return opened_;
+}
+
+/*
+ * Find the line entry covering `instnAddr`. Entries may overlap, the one
+ * with the largest start address not above `instnAddr` wins, which is the
+ * innermost one for inlined code. Only a few preceding entries are scanned
+ * so that a lookup stays logarithmic.
+ */
+bool Symbolizer::lookup(uint64_t instnAddr, SourceLocation& location) const {
+  if (!opened_) {
+    return false;
+  }
+  auto it = std::upper_bound(lineEntries_.begin(), lineEntries_.end(),
+          instnAddr, [](uint64_t addr, const LineEntry& entry) {
+            return addr < entry.start;
+          });
+  for (int i = 0; i < MAX_OVERLAP_SCAN && it != lineEntries_.begin(); ++i) {
+    --it;
+    if (instnAddr < it->end) {
+      location.file = &(fileNames_[it->fileIndex]);
+      location.line = it->line;
+      location.column = it->column;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Resolve `instnAddrs` into `locations` at the same indices. Large inputs
+ * are split across threads, the index is read-only at this point.
+ */
+void Symbolizer::resolve(const std::vector<uint64_t>& instnAddrs,
+                         std::vector<SourceLocation>& locations) const {
+  locations.assign(instnAddrs.size(), SourceLocation());
+  auto resolveRange = [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      lookup(instnAddrs[i], locations[i]);
+    }
+  };
+  size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+  numThreads = std::min(numThreads,
+          instnAddrs.size() / ADDRS_PER_RESOLVE_THREAD + 1);
+  if (numThreads == 1) {
+    resolveRange(0, instnAddrs.size());
+    return;
+  }
+  std::vector<std::thread> workers;
+  auto chunk = (instnAddrs.size() + numThreads - 1) / numThreads;
+  for (size_t i = 0; i < numThreads; ++i) {
+    auto begin = std::min(i * chunk, instnAddrs.size());
+    auto end = std::min(begin + chunk, instnAddrs.size());
+    workers.emplace_back(resolveRange, begin, end);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+/*
+ * Collect the [start, end) address ranges of functions whose mangled or
+ * pretty name is `functionName`.
+ */
+bool Symbolizer::findFunctionRanges(const std::string& functionName,
+        std::vector<std::pair<uint64_t, uint64_t>>& ranges) const {
+  if (!opened_) {
+    return false;
+  }
+  std::vector<Function*> functions;
+  if (!symtab_->findFunctionsByName(functions, functionName)) {
+    return false;
+  }
+  for (auto function : functions) {
+    ranges.emplace_back(function->getOffset(),
+                        function->getOffset() + function->getSize());
+  }
+  return !functions.empty();
+}
+
+/*
+ * Collect the address ranges of lines [firstLine, lastLine] of every file
+ * whose path ends with `fileName`.
+ */
+bool Symbolizer::findLineRanges(const std::string& fileName, int firstLine,
+        int lastLine,
+        std::vector<std::pair<uint64_t, uint64_t>>& ranges) const {
+  if (!opened_) {
+    return false;
+  }
+  std::vector<bool> fileMatches(fileNames_.size(), false);
+  for (size_t i = 0; i < fileNames_.size(); ++i) {
+    const auto& name = fileNames_[i];
+    fileMatches[i] = name.size() >= fileName.size() &&
+        name.compare(name.size() - fileName.size(), fileName.size(), 
+                     fileName) == 0;
+  }
+  auto found = false;
+  for (const auto& entry : lineEntries_) {
+    if (fileMatches[entry.fileIndex] && entry.line >= firstLine && 
+        entry.line <= lastLine) {
+      ranges.emplace_back(entry.start, entry.end);
+      found = true;
+    }
+  }
+  return found;
+}
+
+Symbolizer& getSymbolizer() {
+  static Symbolizer symbolizer;
+  return symbolizer;
+}
+
+}
@@ -4,6 +4,7 @@
 #include <glog/raw_logging.h>
 #include <stack>
 
+#include "Stats.h"
 #include "TaskData.h"
 
 namespace romp {
@@ -100,6 +101,7 @@ void TaskDepGraph::addEdge(void* from, void* to) {
  */
 bool TaskDepGraph::hasPath(void* from, void* to) {
   std::unordered_map<void*, bool> visited;  
+  addStat(eStatHasPath);
   if (_graph.find(from) == _graph.end()) {
     return false;	
   }
@@ -115,6 +117,7 @@ bool TaskDepGraph::hasPath(void* from, void* to) {
       continue; 
     }
     visited[cur] = true;
+    addStat(eStatHasPathNodes);
     for (const auto neighbor : _graph[cur]) {
       if (visited.find(neighbor) == visited.end()) {
         todo.push(neighbor);
@@ -0,0 +1,173 @@
+#!/usr/bin/env bash
+# Measure romp's time and memory overhead over native runs of the ci
+# benchmarks and the OmpSCR applications, then compare the slowdown and
+# memory ratios against a stored baseline.
+#
+# usage: ./overhead-tests.sh [--update-baseline]
+#
+# environment:
+#   OVERHEAD_THREADS     thread counts, default "1 4 8"
+#   OVERHEAD_ITERATIONS  runs per configuration, the fastest is kept, default 3
+#   OVERHEAD_BASELINE    baseline csv, default ./overhead-baseline.csv
+#   OVERHEAD_THRESHOLD   tolerated relative growth of a ratio, default 0.15
+#   OVERHEAD_FILTER      only run benchmarks whose name matches this regex
+#   INST_CLIENT          path to InstrumentMain
+#
+# ROMP_PATH and DYNINSTAPI_RT_LIB have to be set as for any romp run.
+echo "start running overhead-tests.sh"
+CSV_HEADER="name,threads,native-time(seconds),romp-time(seconds),native-mem(KBs),romp-mem(KBs),slowdown,mem-ratio,runtime-return"
+THREADLIST=(${OVERHEAD_THREADS:-"1 4 8"})
+ITERATIONS=${OVERHEAD_ITERATIONS:-3}
+BASELINE=${OVERHEAD_BASELINE:-"$(pwd)/overhead-baseline.csv"}
+THRESHOLD=${OVERHEAD_THRESHOLD:-0.15}
+FILTER=${OVERHEAD_FILTER:-"."}
+OUTPUT_DIR="results"
+LOG_DIR="$OUTPUT_DIR/log"
+EXEC_DIR="$OUTPUT_DIR/overhead-exec"
+MEMCHECK=${MEMCHECK:-"/usr/bin/time"}
+TIMEOUTCMD=${TIMEOUTCMD:-"timeout"}
+TIMEOUTMIN="10"
+INST_CLIENT=${INST_CLIENT:-"$(pwd)/../../install/bin/InstrumentMain"}
+OMPSCR_DIR="$(pwd)/../OmpSCR_v2.0"
+ROMP_CPP_COMPILE_FLAGS="-g -std=c++11 -fopenmp -lomp"
+ROMP_C_COMPILE_FLAGS="-g -fopenmp -lomp"
+POLYFLAG="benchmarks/utilities/polybench.c -I benchmarks -I benchmarks/utilities -DPOLYBENCH_NO_FLUSH_CACHE -DPOLYBENCH_TIME -D_POSIX_C_SOURCE=200112L"
+VARLEN_PATTERN='[[:alnum:]]+-var-[[:alnum:]]+\.c'
+CPP_PATTERN='[[:alnum:]]+\.cpp'
+VARLEN_SIZE="1024"
+
+UPDATE_BASELINE=false
+if [[ "$1" == "--update-baseline" ]]; then UPDATE_BASELINE=true; fi
+
+mkdir -p "$OUTPUT_DIR"
+mkdir -p "$LOG_DIR"
+mkdir -p "$EXEC_DIR"
+
+ULIMITS=$(ulimit -s)
+ulimit -s unlimited
+
+MEMLOG="$LOG_DIR/overhead.memlog"
+file="$OUTPUT_DIR/overhead.csv"
+echo "Saving to: $file"
+[ -e "$file" ] && rm "$file"
+echo "$CSV_HEADER" >> "$file"
+
+# names of the executables to measure and the arguments to run them with
+NAMES=()
+ARGS=()
+
+# build the ci benchmarks the same way as ci-tests.sh
+for test in $(grep -l main ./benchmarks/*.cpp ./benchmarks/*.c); do
+  testname=$(basename "$test")
+  if ! [[ "$testname" =~ $FILTER ]]; then continue; fi
+  exname="$EXEC_DIR/$testname.out"
+  additional_compile_flags=''
+  if grep -q 'PolyBench' "$test"; then additional_compile_flags+=" $POLYFLAG"; fi
+  if [[ "$test" =~ $CPP_PATTERN ]]; then
+    g++ $ROMP_CPP_COMPILE_FLAGS $additional_compile_flags "$test" -o "$exname" -lm
+  else
+    gcc $ROMP_C_COMPILE_FLAGS $additional_compile_flags "$test" -o "$exname" -lm
+  fi
+  if [[ $? -ne 0 ]]; then echo "failed to compile $test"; continue; fi
+  NAMES+=("$testname")
+  if [[ "$test" =~ $VARLEN_PATTERN ]]; then ARGS+=("$VARLEN_SIZE"); else ARGS+=(""); fi
+done
+
+# build the parallel versions of the OmpSCR applications with their makefiles
+if make -C "$OMPSCR_DIR" par &> "$LOG_DIR/ompscr-build.log"; then
+  for exe in "$OMPSCR_DIR"/bin/*.par; do
+    testname=$(basename "$exe")
+    if ! [[ "$testname" =~ $FILTER ]]; then continue; fi
+    cp "$exe" "$EXEC_DIR/$testname.out"
+    NAMES+=("$testname")
+    ARGS+=("-test")
+  done
+else
+  echo "failed to build OmpSCR, see $LOG_DIR/ompscr-build.log"
+fi
+
+# run `$1` with the remaining arguments, set `besttime` and `bestmem` to the
+# fastest of ITERATIONS runs and `runreturn` to the last return code
+measure () {
+  local exe=$1
+  shift
+  besttime=""
+  bestmem=""
+  runreturn=0
+  for ITER in $(seq 1 "$ITERATIONS"); do
+    start=$(date +%s%6N)
+    $TIMEOUTCMD $TIMEOUTMIN"m" $MEMCHECK -f "%M" -o "$MEMLOG" "$exe" "$@" &> tmp.log
+    runreturn=$?
+    end=$(date +%s%6N)
+    if [[ $runreturn -ne 0 ]]; then return; fi
+    elapsedtime=$(echo "scale=3; ($end-$start)/1000000"|bc)
+    mem=$(tail -n 1 "$MEMLOG")
+    if [[ -z "$besttime" ]] || (( $(echo "$elapsedtime < $besttime"|bc) )); then
+      besttime=$elapsedtime
+      bestmem=$mem
+    fi
+  done
+}
+
+for index in "${!NAMES[@]}"; do
+  testname=${NAMES[$index]}
+  args=${ARGS[$index]}
+  exname="$EXEC_DIR/$testname.out"
+  rompexec="$exname.inst"
+  $INST_CLIENT --program="$exname" &> "$LOG_DIR/$testname.inst.log"
+  if [[ ! -e "$rompexec" ]]; then
+    echo "failed to instrument $testname"
+    continue
+  fi
+  for thread in "${THREADLIST[@]}"; do
+    export OMP_NUM_THREADS=$thread
+    measure "$exname" $args
+    nativetime=$besttime
+    nativemem=$bestmem
+    nativereturn=$runreturn
+    measure "$rompexec" $args
+    if [[ $nativereturn -ne 0 || $runreturn -ne 0 || -z "$nativetime" ]]; then
+      echo "$testname,$thread,,,,,,,$runreturn" >> "$file"
+      continue
+    fi
+    ratios=$(echo "$besttime $nativetime $bestmem $nativemem" | awk '{
+      slowdown = $2 > 0 ? $1 / $2 : 0
+      memratio = $4 > 0 ? $3 / $4 : 0
+      printf "%.2f,%.2f", slowdown, memratio }')
+    echo "$testname,$thread,$nativetime,$besttime,$nativemem,$bestmem,$ratios,$runreturn" >> "$file"
+    echo "$testname with $thread threads: slowdown,mem-ratio = $ratios"
+  done
+done
+
+ulimit -s "$ULIMITS"
+
+if [[ "$UPDATE_BASELINE" = true ]]; then
+  cp "$file" "$BASELINE"
+  echo "baseline updated: $BASELINE"
+  exit 0
+fi
+
+if [[ ! -e "$BASELINE" ]]; then
+  echo "no baseline at $BASELINE, run with --update-baseline to create one"
+  exit 0
+fi
+
+# a ratio regresses if it grows by more than THRESHOLD relative to baseline
+awk -F, -v threshold="$THRESHOLD" '
+  FNR == 1 { next }
+  NR == FNR { slowdown[$1","$2] = $7; memratio[$1","$2] = $8; next }
+  ($1","$2) in slowdown && $7 != "" {
+    key = $1","$2
+    if (slowdown[key] > 0 && $7 > slowdown[key] * (1 + threshold)) {
+      printf "regression: %s slowdown %s -> %s\n", key, slowdown[key], $7
+      regressions++
+    }
+    if (memratio[key] > 0 && $8 > memratio[key] * (1 + threshold)) {
+      printf "regression: %s mem-ratio %s -> %s\n", key, memratio[key], $8
+      regressions++
+    }
+  }
+  END {
+    printf "%d overhead regressions against baseline\n", regressions
+    exit regressions > 0
+  }' "$BASELINE" "$file"
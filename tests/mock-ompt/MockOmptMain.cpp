@@ -0,0 +1,253 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <glog/logging.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "MockRuntime.h"
+#include "RaceReport.h"
+
+/*
+ * Replay an ompt event script against libromp through the mock runtime.
+ * One command per line, `#` starts a comment:
+ *
+ *   thread <id>                       switch to simulated thread <id>
+ *   parallel_begin <name> <team size> current task encounters a region
+ *   parallel_end <name>
+ *   implicit_begin <name> <index>     begin implicit task <index> of region
+ *   implicit_end
+ *   barrier | taskwait | taskgroup_begin | taskgroup_end
+ *   loop_begin | loop_end
+ *   dispatch <iteration>
+ *   lock <wait id> | unlock <wait id>
+ *   task_create <name> [in|out|inout:<offset>]...
+ *   task_begin <name>                 switch to the explicit task
+ *   task_end                          complete the current explicit task
+ *   space arena|data|rodata           address space of later accesses
+ *   read|write <offset> <bytes> <instn> [<count> [<stride>]]
+ *   repeat <count> ... end            replay the enclosed commands
+ *   expect_races <count>              exit with 1 if the count differs
+ *
+ * Offsets are relative to a reserved arena by default, or to a static 
+ * buffer in .bss or .rodata. Instruction addresses are hex. Like 
+ * instrumented code, accesses only call `checkAccess` while libromp sets 
+ * `gRompCheckEnabled`.
+ *
+ * usage: mock-ompt <script>
+ */
+
+using namespace mock;
+
+typedef struct Command {
+  int lineNum;
+  std::vector<std::string> args;
+  size_t matchIndex; // for repeat and end, index of the matching command
+} Command;
+
+static std::vector<Command> parseScript(const std::string& scriptPath) {
+  std::ifstream input(scriptPath);
+  if (!input.is_open()) {
+    LOG(FATAL) << "cannot open script: " << scriptPath;
+  }
+  std::vector<Command> commands;
+  std::vector<size_t> openRepeats;
+  std::string line;
+  auto lineNum = 0;
+  while (std::getline(input, line)) {
+    lineNum++;
+    auto comment = line.find('#');
+    if (comment != std::string::npos) {
+      line.erase(comment);
+    }
+    Command command;
+    command.lineNum = lineNum;
+    command.matchIndex = 0;
+    std::istringstream tokens(line);
+    std::string token;
+    while (tokens >> token) {
+      command.args.push_back(token);
+    }
+    if (command.args.empty()) {
+      continue;
+    }
+    if (command.args[0] == "repeat") {
+      openRepeats.push_back(commands.size());
+    } else if (command.args[0] == "end") {
+      if (openRepeats.empty()) {
+        LOG(FATAL) << scriptPath << ":" << lineNum << ": unmatched end";
+      }
+      command.matchIndex = openRepeats.back();
+      commands[openRepeats.back()].matchIndex = commands.size();
+      openRepeats.pop_back();
+    }
+    commands.push_back(command);
+  }
+  if (!openRepeats.empty()) {
+    LOG(FATAL) << scriptPath << ": repeat without end";
+  }
+  return commands;
+}
+
+static uint64_t parseNumber(const Command& command, size_t index,
+                            int base = 10) {
+  if (index >= command.args.size()) {
+    LOG(FATAL) << "line " << command.lineNum << ": missing argument";
+  }
+  char* end = nullptr;
+  auto value = strtoull(command.args[index].c_str(), &end, base);
+  if (*end != '\0') {
+    LOG(FATAL) << "line " << command.lineNum << ": bad number `"
+               << command.args[index] << "`";
+  }
+  return value;
+}
+
+static const std::string& getArg(const Command& command, size_t index) {
+  if (index >= command.args.size()) {
+    LOG(FATAL) << "line " << command.lineNum << ": missing argument";
+  }
+  return command.args[index];
+}
+
+static ompt_dependence_t parseDependence(const Command& command,
+                                         const std::string& spec) {
+  auto colon = spec.find(':');
+  auto kind = spec.substr(0, colon);
+  ompt_dependence_t dependence;
+  if (kind == "in") {
+    dependence.dependence_type = ompt_dependence_type_in;
+  } else if (kind == "out") {
+    dependence.dependence_type = ompt_dependence_type_out;
+  } else if (kind == "inout") {
+    dependence.dependence_type = ompt_dependence_type_inout;
+  } else {
+    LOG(FATAL) << "line " << command.lineNum << ": bad dependence `" << spec
+               << "`";
+  }
+  auto offset = strtoull(spec.c_str() + colon + 1, nullptr, 10);
+  dependence.variable.ptr = MockRuntime::instance().getArenaAddress(offset);
+  return dependence;
+}
+
+/*
+ * Execute one command and return the index of the next one. `loopCounts`
+ * holds the remaining iterations of every repeat block.
+ */
+static size_t execute(const std::vector<Command>& commands, size_t index,
+                      std::vector<uint64_t>& loopCounts,
+                      int64_t& expectedRaces) {
+  auto& runtime = MockRuntime::instance();
+  const auto& command = commands[index];
+  const auto& name = command.args[0];
+  if (name == "repeat") {
+    loopCounts[index] = parseNumber(command, 1);
+    if (loopCounts[index] == 0) {
+      return command.matchIndex + 1;
+    }
+  } else if (name == "end") {
+    if (--loopCounts[command.matchIndex] > 0) {
+      return command.matchIndex + 1;
+    }
+  } else if (name == "thread") {
+    runtime.switchThread(static_cast<int>(parseNumber(command, 1)));
+  } else if (name == "parallel_begin") {
+    runtime.beginParallel(getArg(command, 1),
+                          static_cast<unsigned int>(parseNumber(command, 2)));
+  } else if (name == "parallel_end") {
+    runtime.endParallel(getArg(command, 1));
+  } else if (name == "implicit_begin") {
+    runtime.beginImplicitTask(getArg(command, 1),
+            static_cast<unsigned int>(parseNumber(command, 2)));
+  } else if (name == "implicit_end") {
+    runtime.endImplicitTask();
+  } else if (name == "barrier") {
+    runtime.syncRegion(ompt_sync_region_barrier_explicit, ompt_scope_begin);
+    runtime.syncRegion(ompt_sync_region_barrier_explicit, ompt_scope_end);
+  } else if (name == "taskwait") {
+    runtime.syncRegion(ompt_sync_region_taskwait, ompt_scope_begin);
+    runtime.syncRegion(ompt_sync_region_taskwait, ompt_scope_end);
+  } else if (name == "taskgroup_begin") {
+    runtime.syncRegion(ompt_sync_region_taskgroup, ompt_scope_begin);
+  } else if (name == "taskgroup_end") {
+    runtime.syncRegion(ompt_sync_region_taskgroup, ompt_scope_end);
+  } else if (name == "loop_begin") {
+    runtime.work(ompt_work_loop, ompt_scope_begin, 0);
+  } else if (name == "loop_end") {
+    runtime.work(ompt_work_loop, ompt_scope_end, 0);
+  } else if (name == "dispatch") {
+    runtime.dispatch(parseNumber(command, 1));
+  } else if (name == "lock" || name == "unlock") {
+    runtime.mutex(name == "lock", parseNumber(command, 1));
+  } else if (name == "task_create") {
+    std::vector<ompt_dependence_t> deps;
+    for (size_t i = 2; i < command.args.size(); ++i) {
+      deps.push_back(parseDependence(command, command.args[i]));
+    }
+    runtime.createTask(getArg(command, 1), deps);
+  } else if (name == "task_begin") {
+    runtime.beginTask(getArg(command, 1));
+  } else if (name == "task_end") {
+    runtime.endTask();
+  } else if (name == "space") {
+    const auto& space = getArg(command, 1);
+    if (space == "arena") {
+      runtime.setAddressSpace(eArena);
+    } else if (space == "data") {
+      runtime.setAddressSpace(eStaticData);
+    } else if (space == "rodata") {
+      runtime.setAddressSpace(eReadOnlyData);
+    } else {
+      LOG(FATAL) << "line " << command.lineNum << ": bad address space `"
+                 << space << "`";
+    }
+  } else if (name == "read" || name == "write") {
+    auto offset = parseNumber(command, 1);
+    auto bytes = static_cast<uint32_t>(parseNumber(command, 2));
+    auto instnAddr = parseNumber(command, 3, 16);
+    auto count = command.args.size() > 4 ? parseNumber(command, 4) : 1;
+    auto stride = command.args.size() > 5 ? parseNumber(command, 5) : bytes;
+    for (uint64_t i = 0; i < count; ++i) {
+      runtime.access(offset + i * stride, bytes, instnAddr, name == "write");
+    }
+  } else if (name == "expect_races") {
+    expectedRaces = static_cast<int64_t>(parseNumber(command, 1));
+  } else {
+    LOG(FATAL) << "line " << command.lineNum << ": unknown command `" << name
+               << "`";
+  }
+  return index + 1;
+}
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  if (argc != 2) {
+    LOG(ERROR) << "usage: " << argv[0] << " <script>";
+    return 2;
+  }
+  auto commands = parseScript(argv[1]);
+  std::vector<uint64_t> loopCounts(commands.size(), 0);
+  int64_t expectedRaces = -1;
+  auto& runtime = MockRuntime::instance();
+  auto start = std::chrono::steady_clock::now();
+  runtime.start();
+  size_t index = 0;
+  while (index < commands.size()) {
+    index = execute(commands, index, loopCounts, expectedRaces);
+  }
+  runtime.finish();
+  auto end = std::chrono::steady_clock::now();
+  auto seconds = std::chrono::duration<double>(end - start).count();
+  auto numDataRace = romp::getNumDataRace();
+  LOG(INFO) << "mock replay of " << argv[1] << ": " << runtime.getNumEvents()
+            << " events, " << runtime.getNumAccesses() << " accesses, "
+            << numDataRace << " races in " << seconds << " s";
+  if (expectedRaces >= 0 &&
+      static_cast<uint64_t>(expectedRaces) != numDataRace) {
+    LOG(ERROR) << "expected " << expectedRaces << " races, found "
+               << numDataRace;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,449 @@
+#include "MockRuntime.h"
+
+#include <cstring>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/*
+ * Simulated accesses go to a reserved but never touched address range, so
+ * they cannot alias the stack or libromp's own data.
+ */
+#define MOCK_ARENA_SIZE (1ULL << 32)
+#define MOCK_STATIC_SIZE 4096
+
+static char gStaticData[MOCK_STATIC_SIZE];
+static const char kReadOnlyData[MOCK_STATIC_SIZE] = {1};
+
+extern "C" {
+
+ompt_start_tool_result_t* ompt_start_tool(unsigned int ompVersion,
+                                          const char* runtimeVersion);
+
+void checkAccess(void* address, uint32_t bytesAccessed, void* instnAddr,
+                 bool hwLock, bool isWrite);
+
+extern int gRompCheckEnabled;
+
+}
+
+namespace mock {
+
+MockRuntime& MockRuntime::instance() {
+  static MockRuntime runtime;
+  return runtime;
+}
+
+MockRuntime::MockRuntime(): toolResult_(nullptr), curThread_(nullptr),
+    stackBase_(nullptr), arena_(nullptr), space_(eArena), numEvents_(0),
+    numAccesses_(0) {
+  memset(callbacks_, 0, sizeof(callbacks_));
+  memset(&initialParallel_, 0, sizeof(MockParallel));
+  initialParallel_.teamSize = 1;
+  pthread_attr_t attr;
+  size_t stackSize = 0;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0 ||
+      pthread_attr_getstack(&attr, &stackBase_, &stackSize) != 0) {
+    LOG(FATAL) << "cannot get stack of the mock runtime thread";
+  }
+  arena_ = mmap(nullptr, MOCK_ARENA_SIZE, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (arena_ == MAP_FAILED) {
+    LOG(FATAL) << "cannot reserve the mock access arena";
+  }
+}
+
+template <typename T>
+T MockRuntime::getCallback(ompt_callbacks_t which) const {
+  return reinterpret_cast<T>(callbacks_[which]);
+}
+
+ompt_interface_fn_t MockRuntime::lookup(const char* name) {
+  auto functionName = std::string(name);
+  if (functionName == "ompt_set_callback") {
+    return reinterpret_cast<ompt_interface_fn_t>(&MockRuntime::setCallback);
+  } else if (functionName == "ompt_get_task_info") {
+    return reinterpret_cast<ompt_interface_fn_t>(&MockRuntime::getTaskInfo);
+  } else if (functionName == "ompt_get_parallel_info") {
+    return reinterpret_cast<ompt_interface_fn_t>(
+            &MockRuntime::getParallelInfo);
+  } else if (functionName == "ompt_get_thread_data") {
+    return reinterpret_cast<ompt_interface_fn_t>(&MockRuntime::getThreadData);
+  } else if (functionName == "ompt_get_task_memory") {
+    return reinterpret_cast<ompt_interface_fn_t>(&MockRuntime::getTaskMemory);
+  }
+  LOG(WARNING) << "mock runtime does not implement " << functionName;
+  return nullptr;
+}
+
+int MockRuntime::setCallback(ompt_callbacks_t which,
+                             ompt_callback_t callback) {
+  auto& runtime = instance();
+  if (which < 0 || static_cast<size_t>(which) >=
+          sizeof(runtime.callbacks_) / sizeof(ompt_callback_t)) {
+    return ompt_set_never;
+  }
+  runtime.callbacks_[which] = callback;
+  return ompt_set_always;
+}
+
+int MockRuntime::getTaskInfo(int ancestorLevel, int* type,
+                             ompt_data_t** taskData, ompt_frame_t** taskFrame,
+                             ompt_data_t** parallelData, int* threadNum) {
+  auto task = instance().getCurTask();
+  for (int i = 0; i < ancestorLevel && task; ++i) {
+    task = task->parent;
+  }
+  if (!task) {
+    return 0;
+  }
+  if (type) {
+    *type = task->type;
+  }
+  if (taskData) {
+    *taskData = &task->data;
+  }
+  if (taskFrame) {
+    *taskFrame = &task->frame;
+  }
+  if (parallelData) {
+    *parallelData = &task->parallel->data;
+  }
+  if (threadNum) {
+    *threadNum = task->threadNum;
+  }
+  return 2;
+}
+
+int MockRuntime::getParallelInfo(int ancestorLevel,
+                                 ompt_data_t** parallelData, int* teamSize) {
+  auto task = instance().getCurTask();
+  auto parallel = task ? task->parallel : nullptr;
+  for (int i = 0; i < ancestorLevel && parallel; ++i) {
+    parallel = parallel->parent;
+  }
+  if (!parallel) {
+    return 0;
+  }
+  if (parallelData) {
+    *parallelData = &parallel->data;
+  }
+  if (teamSize) {
+    *teamSize = static_cast<int>(parallel->teamSize);
+  }
+  return 2;
+}
+
+ompt_data_t* MockRuntime::getThreadData() {
+  auto thread = instance().curThread_;
+  return thread ? &thread->data : nullptr;
+}
+
+/*
+ * Simulated explicit tasks have no firstprivate data block.
+ */
+int MockRuntime::getTaskMemory(void** addr, size_t* size, int block) {
+  return 0;
+}
+
+MockTask* MockRuntime::getCurTask() const {
+  return curThread_ ? curThread_->curTask : nullptr;
+}
+
+/*
+ * The exit frame of every simulated task is the lowest address of the real
+ * stack, so task stack recycling in libromp covers an empty range.
+ */
+MockTask* MockRuntime::newTask(int type, MockTask* parent,
+                               MockParallel* parallel) {
+  auto task = new MockTask();
+  memset(task, 0, sizeof(MockTask));
+  task->type = type;
+  task->parent = parent;
+  task->parallel = parallel;
+  task->frame.exit_frame.ptr = stackBase_;
+  task->frame.enter_frame.ptr = stackBase_;
+  return task;
+}
+
+/*
+ * Load libromp the way the OpenMP runtime does and start simulated thread 0
+ * with the initial task.
+ */
+void MockRuntime::start() {
+  toolResult_ = ompt_start_tool(201611, "mock ompt runtime");
+  if (!toolResult_) {
+    LOG(FATAL) << "ompt_start_tool returned null";
+  }
+  toolResult_->initialize(&MockRuntime::lookup, 0, &toolResult_->tool_data);
+  switchThread(0);
+  auto initialTask = newTask(ompt_task_initial, nullptr, &initialParallel_);
+  curThread_->curTask = initialTask;
+  numEvents_++;
+  getCallback<ompt_callback_implicit_task_t>(ompt_callback_implicit_task)(
+      ompt_scope_begin, &initialParallel_.data, &initialTask->data, 1, 0,
+      ompt_task_initial);
+}
+
+/*
+ * End all simulated threads and finalize the tool. libromp ignores the end
+ * of the initial task, so it is not reported.
+ */
+void MockRuntime::finish() {
+  auto threadEnd = getCallback<ompt_callback_thread_end_t>(
+          ompt_callback_thread_end);
+  for (auto& entry : threads_) {
+    curThread_ = entry.second.get();
+    if (entry.first != 0 && curThread_->curTask) {
+      LOG(FATAL) << "thread " << entry.first << " still executes a task";
+    }
+    numEvents_++;
+    threadEnd(&curThread_->data);
+  }
+  toolResult_->finalize(&toolResult_->tool_data);
+  curThread_ = nullptr;
+}
+
+/*
+ * Make `threadId` the current simulated thread, beginning the thread on
+ * first use.
+ */
+void MockRuntime::switchThread(int threadId) {
+  auto& thread = threads_[threadId];
+  if (!thread) {
+    thread.reset(new MockThread());
+    memset(thread.get(), 0, sizeof(MockThread));
+    curThread_ = thread.get();
+    numEvents_++;
+    getCallback<ompt_callback_thread_begin_t>(ompt_callback_thread_begin)(
+        threadId == 0 ? ompt_thread_initial : ompt_thread_worker,
+        &thread->data);
+  }
+  curThread_ = thread.get();
+}
+
+void MockRuntime::beginParallel(const std::string& name,
+                                unsigned int teamSize) {
+  auto encounteringTask = getCurTask();
+  if (!encounteringTask) {
+    LOG(FATAL) << "parallel region " << name << " has no encountering task";
+  }
+  auto& parallel = parallels_[name];
+  if (parallel) {
+    LOG(FATAL) << "parallel region " << name << " is active already";
+  }
+  parallel.reset(new MockParallel());
+  memset(parallel.get(), 0, sizeof(MockParallel));
+  parallel->teamSize = teamSize;
+  parallel->parent = encounteringTask->parallel;
+  parallel->encounteringTask = encounteringTask;
+  numEvents_++;
+  getCallback<ompt_callback_parallel_begin_t>(ompt_callback_parallel_begin)(
+      &encounteringTask->data, &encounteringTask->frame, &parallel->data,
+      teamSize, ompt_parallel_invoker_program | ompt_parallel_team, nullptr);
+}
+
+void MockRuntime::endParallel(const std::string& name) {
+  auto it = parallels_.find(name);
+  if (it == parallels_.end()) {
+    LOG(FATAL) << "parallel region " << name << " is not active";
+  }
+  auto parallel = it->second.get();
+  if (getCurTask() != parallel->encounteringTask) {
+    LOG(FATAL) << "parallel region " << name
+               << " must end on its encountering task";
+  }
+  numEvents_++;
+  getCallback<ompt_callback_parallel_end_t>(ompt_callback_parallel_end)(
+      &parallel->data, &parallel->encounteringTask->data,
+      ompt_parallel_invoker_program | ompt_parallel_team, nullptr);
+  parallels_.erase(it);
+}
+
+/*
+ * Begin implicit task `index` of the region on the current thread. Index 0
+ * runs on the thread of the encountering task, others on idle threads.
+ */
+void MockRuntime::beginImplicitTask(const std::string& name,
+                                    unsigned int index) {
+  auto it = parallels_.find(name);
+  if (it == parallels_.end()) {
+    LOG(FATAL) << "parallel region " << name << " is not active";
+  }
+  auto parallel = it->second.get();
+  if (index >= parallel->teamSize) {
+    LOG(FATAL) << "implicit task index " << index << " exceeds team size";
+  }
+  auto curTask = getCurTask();
+  if (index == 0 ? curTask != parallel->encounteringTask : curTask != nullptr) {
+    LOG(FATAL) << "implicit task " << index << " of " << name
+               << " cannot begin on the current thread";
+  }
+  auto task = newTask(ompt_task_implicit, parallel->encounteringTask,
+                      parallel);
+  task->threadNum = index;
+  task->resumeTask = curTask;
+  curThread_->curTask = task;
+  numEvents_++;
+  getCallback<ompt_callback_implicit_task_t>(ompt_callback_implicit_task)(
+      ompt_scope_begin, &parallel->data, &task->data, parallel->teamSize,
+      index, ompt_task_implicit);
+}
+
+/*
+ * Like the LLVM runtime, the end of an implicit task reports no parallel
+ * data and an actual parallelism of 0.
+ */
+void MockRuntime::endImplicitTask() {
+  auto task = getCurTask();
+  if (!task || task->type != ompt_task_implicit) {
+    LOG(FATAL) << "current task is not an implicit task";
+  }
+  numEvents_++;
+  getCallback<ompt_callback_implicit_task_t>(ompt_callback_implicit_task)(
+      ompt_scope_end, nullptr, &task->data, 0, task->threadNum,
+      ompt_task_implicit);
+  curThread_->curTask = task->resumeTask;
+  delete task;
+}
+
+void MockRuntime::syncRegion(ompt_sync_region_t kind,
+                             ompt_scope_endpoint_t endPoint) {
+  auto task = getCurTask();
+  if (!task) {
+    LOG(FATAL) << "sync region outside of a task";
+  }
+  numEvents_++;
+  getCallback<ompt_callback_sync_region_t>(ompt_callback_sync_region)(kind,
+      endPoint, &task->parallel->data, &task->data, nullptr);
+}
+
+void MockRuntime::work(ompt_work_t kind, ompt_scope_endpoint_t endPoint,
+                       uint64_t count) {
+  auto task = getCurTask();
+  if (!task) {
+    LOG(FATAL) << "work construct outside of a task";
+  }
+  numEvents_++;
+  getCallback<ompt_callback_work_t>(ompt_callback_work)(kind, endPoint,
+      &task->parallel->data, &task->data, count, nullptr);
+}
+
+void MockRuntime::dispatch(uint64_t iteration) {
+  auto task = getCurTask();
+  if (!task) {
+    LOG(FATAL) << "dispatch outside of a task";
+  }
+  ompt_data_t instance;
+  instance.value = iteration;
+  numEvents_++;
+  getCallback<ompt_callback_dispatch_t>(ompt_callback_dispatch)(
+      &task->parallel->data, &task->data, ompt_dispatch_iteration, instance);
+}
+
+void MockRuntime::mutex(bool acquire, uint64_t waitId) {
+  numEvents_++;
+  getCallback<ompt_callback_mutex_t>(acquire ? ompt_callback_mutex_acquired :
+      ompt_callback_mutex_released)(ompt_mutex_lock, waitId, nullptr);
+}
+
+void MockRuntime::createTask(const std::string& name,
+                             const std::vector<ompt_dependence_t>& deps) {
+  auto curTask = getCurTask();
+  if (!curTask) {
+    LOG(FATAL) << "explicit task " << name << " must be created in a task";
+  }
+  auto& task = explicitTasks_[name];
+  if (task) {
+    LOG(FATAL) << "explicit task " << name << " exists already";
+  }
+  task = newTask(ompt_task_explicit, curTask, curTask->parallel);
+  numEvents_++;
+  getCallback<ompt_callback_task_create_t>(ompt_callback_task_create)(
+      &curTask->data, &curTask->frame, &task->data, ompt_task_explicit,
+      !deps.empty(), nullptr);
+  if (!deps.empty()) {
+    numEvents_++;
+    getCallback<ompt_callback_dependences_t>(ompt_callback_dependences)(
+        &task->data, deps.data(), static_cast<int>(deps.size()));
+  }
+}
+
+/*
+ * Switch the current thread from its current task to the explicit task.
+ */
+void MockRuntime::beginTask(const std::string& name) {
+  auto it = explicitTasks_.find(name);
+  if (it == explicitTasks_.end()) {
+    LOG(FATAL) << "explicit task " << name << " does not exist";
+  }
+  auto task = it->second;
+  auto curTask = getCurTask();
+  if (!curTask || task->resumeTask) {
+    LOG(FATAL) << "explicit task " << name << " cannot begin";
+  }
+  task->resumeTask = curTask;
+  task->threadNum = curTask->threadNum;
+  numEvents_++;
+  getCallback<ompt_callback_task_schedule_t>(ompt_callback_task_schedule)(
+      &curTask->data, ompt_task_switch, &task->data);
+  curThread_->curTask = task;
+}
+
+/*
+ * Complete the current explicit task and resume the task it interrupted.
+ */
+void MockRuntime::endTask() {
+  auto task = getCurTask();
+  if (!task || task->type != ompt_task_explicit) {
+    LOG(FATAL) << "current task is not an explicit task";
+  }
+  numEvents_++;
+  getCallback<ompt_callback_task_schedule_t>(ompt_callback_task_schedule)(
+      &task->data, ompt_task_complete, &task->resumeTask->data);
+  curThread_->curTask = task->resumeTask;
+  for (auto it = explicitTasks_.begin(); it != explicitTasks_.end(); ++it) {
+    if (it->second == task) {
+      explicitTasks_.erase(it);
+      break;
+    }
+  }
+  delete task;
+}
+
+void MockRuntime::setAddressSpace(AddressSpace space) {
+  space_ = space;
+}
+
+void MockRuntime::access(uint64_t offset, uint32_t bytes, uint64_t instnAddr,
+                         bool isWrite) {
+  numAccesses_++;
+  // the inline guard of instrumented code
+  if (!__atomic_load_n(&gRompCheckEnabled, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  checkAccess(getAccessAddress(offset), bytes,
+              reinterpret_cast<void*>(instnAddr), false, isWrite);
+}
+
+void* MockRuntime::getAccessAddress(uint64_t offset) const {
+  if (space_ == eArena) {
+    return getArenaAddress(offset);
+  }
+  if (offset >= MOCK_STATIC_SIZE) {
+    LOG(FATAL) << "offset " << offset << " is outside of the static buffer";
+  }
+  if (space_ == eStaticData) {
+    return gStaticData + offset;
+  }
+  return const_cast<char*>(kReadOnlyData) + offset;
+}
+
+void* MockRuntime::getArenaAddress(uint64_t offset) const {
+  if (offset >= MOCK_ARENA_SIZE) {
+    LOG(FATAL) << "offset " << offset << " is outside of the access arena";
+  }
+  return static_cast<char*>(arena_) + offset;
+}
+
+}
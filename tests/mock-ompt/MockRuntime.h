@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ompt.h>
+#include <string>
+#include <vector>
+
+/*
+ * This header file declares a single threaded stand-in for the OpenMP
+ * runtime. Simulated threads, parallel regions and tasks are plain objects
+ * and the current simulated thread is switched explicitly, so an event
+ * sequence is replayed the same way on every run. The runtime answers the
+ * ompt query functions used by libromp and forwards events to the callbacks
+ * libromp registers through ompt_set_callback.
+ */
+namespace mock {
+
+typedef struct MockTask MockTask;
+
+enum AddressSpace {
+  eArena, // reserved range, never touched
+  eStaticData, // buffer in the executable's .bss
+  eReadOnlyData, // buffer in the executable's .rodata
+};
+
+typedef struct MockParallel {
+  ompt_data_t data;
+  unsigned int teamSize;
+  MockParallel* parent;
+  MockTask* encounteringTask;
+} MockParallel;
+
+typedef struct MockTask {
+  ompt_data_t data;
+  ompt_frame_t frame;
+  int type; // ompt_task_flag_t
+  int threadNum;
+  MockParallel* parallel;
+  MockTask* parent; // task reported at ancestor level 1
+  MockTask* resumeTask; // task the thread executed before this task
+} MockTask;
+
+typedef struct MockThread {
+  ompt_data_t data;
+  MockTask* curTask;
+} MockThread;
+
+class MockRuntime {
+  public:
+    static MockRuntime& instance();
+    void start();
+    void finish();
+    void switchThread(int threadId);
+    void beginParallel(const std::string& name, unsigned int teamSize);
+    void endParallel(const std::string& name);
+    void beginImplicitTask(const std::string& name, unsigned int index);
+    void endImplicitTask();
+    void syncRegion(ompt_sync_region_t kind,
+                    ompt_scope_endpoint_t endPoint);
+    void work(ompt_work_t kind, ompt_scope_endpoint_t endPoint,
+              uint64_t count);
+    void dispatch(uint64_t iteration);
+    void mutex(bool acquire, uint64_t waitId);
+    void createTask(const std::string& name,
+                    const std::vector<ompt_dependence_t>& deps);
+    void beginTask(const std::string& name);
+    void endTask();
+    void setAddressSpace(AddressSpace space);
+    void access(uint64_t offset, uint32_t bytes, uint64_t instnAddr,
+                bool isWrite);
+    void* getArenaAddress(uint64_t offset) const;
+    uint64_t getNumEvents() const { return numEvents_; }
+    uint64_t getNumAccesses() const { return numAccesses_; }
+    // ompt entry points handed out by the lookup function
+    static ompt_interface_fn_t lookup(const char* name);
+    static int setCallback(ompt_callbacks_t which, ompt_callback_t callback);
+    static int getTaskInfo(int ancestorLevel, int* type,
+                           ompt_data_t** taskData, ompt_frame_t** taskFrame,
+                           ompt_data_t** parallelData, int* threadNum);
+    static int getParallelInfo(int ancestorLevel, ompt_data_t** parallelData,
+                               int* teamSize);
+    static ompt_data_t* getThreadData();
+    static int getTaskMemory(void** addr, size_t* size, int block);
+  private:
+    MockRuntime();
+    MockTask* getCurTask() const;
+    void* getAccessAddress(uint64_t offset) const;
+    MockTask* newTask(int type, MockTask* parent, MockParallel* parallel);
+    template <typename T> T getCallback(ompt_callbacks_t which) const;
+    ompt_start_tool_result_t* toolResult_;
+    ompt_callback_t callbacks_[64];
+    std::map<int, std::unique_ptr<MockThread>> threads_;
+    std::map<std::string, std::unique_ptr<MockParallel>> parallels_;
+    std::map<std::string, MockTask*> explicitTasks_;
+    MockThread* curThread_;
+    MockParallel initialParallel_;
+    void* stackBase_;
+    void* arena_;
+    AddressSpace space_;
+    uint64_t numEvents_;
+    uint64_t numAccesses_;
+};
+
+}